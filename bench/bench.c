@@ -0,0 +1,707 @@
+/*
+ * Benchmarks for the gui's hot paths. Needs a GL context for fonts and everything that uploads,
+ * an invisible window provides it. Formatting and the omath kernels run without one, and
+ * without a font file.
+ * Usage: bench [-json <results file>] [<font file> [height]]
+ *        bench -compare <baseline results> <results> [tolerance in percent]
+ * -compare lists the change of each benchmark's mean time and fails if one got slower than
+ * the tolerance allows, 10% by default.
+ */
+
+#define _POSIX_C_SOURCE 200809L	// clock_gettime() also with -std=c11
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "glad/glad.h"
+#include <GLFW/glfw3.h>
+#include "src/font.h"
+#include "src/gui_window.h"
+#include "src/gui_format.h"
+#include "src/gui_soft.h"
+#include "omath/mat4f.h"
+#include "omath/vec3f.h"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#define BENCH_BAKED_FILE "bench_font.vvsf"
+#define BENCH_ITERATIONS 50
+// Text laid out per iteration of the glyph benchmark, and how often
+#define BENCH_GLYPH_TEXT "Framerate: 59.94 fps, frame #123456, AVWay Tg kerning pairs ..."
+#define BENCH_GLYPH_REPEATS 1000
+// Values formatted per iteration of the format benchmark
+#define BENCH_FORMAT_VALUES 100000
+// Frame the software renderer composites into
+#define BENCH_SOFT_WIDTH 1280
+#define BENCH_SOFT_HEIGHT 720
+// Matrices and vectors per iteration of the omath benchmark
+#define BENCH_MATH_COUNT 100000
+// Variables of the window in the update benchmark, and updates per iteration
+#define BENCH_UPDATE_VARIABLES 64
+#define BENCH_UPDATE_FRAMES 100
+#define BENCH_MAX_RESULTS 64
+#define BENCH_MAX_NAME 48
+#define BENCH_DEFAULT_TOLERANCE 10.0
+
+typedef struct {
+	char name[BENCH_MAX_NAME];
+	double first_ms;
+	double mean_ms;
+	int runs;
+	// Items processed per second, 0 if not measured
+	double per_second;
+} bench_result_t;
+
+// Everything reported, written by -json
+static bench_result_t results[BENCH_MAX_RESULTS];
+static int num_results = 0;
+
+static double bench_now() {
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static void bench_report( const char* name, double first, double total, int iterations ) {
+	printf( "%-32s first %9.3f ms   mean %9.3f ms   (%d runs)\n",
+			name, first * 1e3, total * 1e3 / iterations, iterations );
+	if( num_results == BENCH_MAX_RESULTS )
+		return;
+	bench_result_t* r = &results[num_results++];
+	snprintf( r->name, sizeof( r->name ), "%s", name );
+	r->first_ms = first * 1e3;
+	r->mean_ms = total * 1e3 / iterations;
+	r->runs = iterations;
+	r->per_second = 0.0;
+}
+
+/* Throughput of the last reported benchmark that processed items per run */
+static void bench_throughput( double items, const char* unit ) {
+	if( 0 == num_results )
+		return;
+	bench_result_t* r = &results[num_results - 1];
+	r->per_second = r->mean_ms > 0.0 ? items / ( r->mean_ms * 1e-3 ) : 0.0;
+	printf( "%-32s %.3f M %s/s\n", "", r->per_second * 1e-6, unit );
+}
+
+/* Startup cost of a font until its atlas is on the GPU: FreeType rasterization
+ * versus the memory mapped baked atlas */
+static void bench_font_startup( const char* font_file, unsigned int height ) {
+	font_info_t* font = font_create( font_file, height );
+	if( NULL == font || !font_bake( font, BENCH_BAKED_FILE ) ) {
+		fputs( "font_startup: could not bake font\n", stderr );
+		return;
+	}
+	font_delete( font );
+	for( int path = 0; path < 2; ++path ) {
+		double first = 0.0, total = 0.0;
+		for( int i = 0; i < BENCH_ITERATIONS; ++i ) {
+			const double t0 = bench_now();
+			font = 0 == path ? font_create( font_file, height ) : font_create_from_baked( BENCH_BAKED_FILE );
+			glFinish();
+			const double t = bench_now() - t0;
+			if( NULL == font )
+				return;
+			font_delete( font );
+			first = 0 == i ? t : first;
+			total += t;
+		}
+		bench_report( 0 == path ? "font_startup/freetype" : "font_startup/baked", first, total, BENCH_ITERATIONS );
+	}
+	remove( BENCH_BAKED_FILE );
+}
+
+/* The former font_create(): measures every glyph in a first pass, renders it again in
+ * a second and uploads each one on its own. Kept to compare against */
+static GLuint bench_legacy_font_atlas( const char* font_file, unsigned int height ) {
+	FT_Library ft;
+	FT_Face face;
+	if( FT_Init_FreeType( &ft ) )
+		return 0;
+	if( FT_New_Face( ft, font_file, 0, &face ) ) {
+		FT_Done_FreeType( ft );
+		return 0;
+	}
+	FT_Set_Pixel_Sizes( face, 0, height );
+	FT_GlyphSlot g = face->glyph;
+	unsigned int w = 0, h = 0;
+	for( unsigned int i = 32; i < 128; ++i ) {
+		if( FT_Load_Char( face, i, FT_LOAD_RENDER ) )
+			continue;
+		w += g->bitmap.width;
+		h = h > g->bitmap.rows ? h : g->bitmap.rows;
+	}
+	GLint upa;
+	glGetIntegerv( GL_UNPACK_ALIGNMENT, &upa );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	GLuint texture;
+	glCreateTextures( GL_TEXTURE_2D, 1, &texture );
+	glTextureStorage2D( texture, 1, GL_R8, (GLsizei)w, (GLsizei)h );
+	int offset_x = 0;
+	for( unsigned int i = 32; i < 128; ++i ) {
+		if( FT_Load_Char( face, i, FT_LOAD_RENDER ) )
+			continue;
+		glTextureSubImage2D( texture, 0, offset_x, 0, (GLsizei)g->bitmap.width, (GLsizei)g->bitmap.rows,
+				GL_RED, GL_UNSIGNED_BYTE, g->bitmap.buffer );
+		offset_x += (int)g->bitmap.width;
+	}
+	glPixelStorei( GL_UNPACK_ALIGNMENT, upa );
+	FT_Done_Face( face );
+	FT_Done_FreeType( ft );
+	return texture;
+}
+
+/* Atlas creation with two passes and one upload per glyph versus one pass
+ * into a staging image and a single upload */
+static void bench_font_upload( const char* font_file, unsigned int height ) {
+	for( int path = 0; path < 2; ++path ) {
+		double first = 0.0, total = 0.0;
+		for( int i = 0; i < BENCH_ITERATIONS; ++i ) {
+			const double t0 = bench_now();
+			GLuint texture = 0;
+			font_info_t* font = NULL;
+			if( 0 == path )
+				texture = bench_legacy_font_atlas( font_file, height );
+			else
+				font = font_create( font_file, height );
+			glFinish();
+			const double t = bench_now() - t0;
+			if( 0 == texture && NULL == font )
+				return;
+			if( 0 != texture )
+				glDeleteTextures( 1, &texture );
+			if( NULL != font )
+				font_delete( font );
+			first = 0 == i ? t : first;
+			total += t;
+		}
+		bench_report( 0 == path ? "font_upload/two_pass" : "font_upload/staging", first, total, BENCH_ITERATIONS );
+	}
+}
+
+// The former six vertices per glyph, 120 bytes
+typedef struct {
+	vec4f coords;
+	float layer;
+} bench_legacy_vertex_t;
+
+/* The former glyph_screen_coords(): a quad of two triangles per glyph. Kept to compare against */
+static void bench_legacy_glyph_vertices( bench_legacy_vertex_t* buffer, GLsizei* index, const char* text,
+		const font_info_t* font, float position_x, float position_y, float scale ) {
+	const float layer = (float)font->atlas_layer;
+	const char* p = text;
+	unsigned int prev = 96;
+	for( unsigned int c = font_utf8_next( &p ); 0 != c; c = font_utf8_next( &p ) ) {
+		const unsigned int k = c - 32;
+		if( prev < 96 && k < 96 )
+			position_x += font->kerning[prev][k] * scale;
+		prev = k;
+		const glyph_info_t* g = font_get_glyph( font, c, false );
+		if( NULL == g )
+			continue;
+		float pen_x = position_x;
+		if( font->subpixel_phases > 1 && k < 96 ) {
+			pen_x = floorf( position_x );
+			unsigned int phase = (unsigned int)( ( position_x - pen_x ) * (float)font->subpixel_phases + 0.5f );
+			if( phase == font->subpixel_phases ) {
+				pen_x += 1.0f;
+				phase = 0;
+			}
+			if( phase > 0 )
+				g = &font->subpixel_glyphs[( phase - 1 ) * 96 + k];
+		}
+		const float x2 = pen_x + g->bearing_x * scale;
+		const float y2 = position_y - ( g->size_y - g->bearing_y ) * scale;
+		const float w = g->size_x * scale;
+		const float h = g->size_y * scale;
+		position_x += g->ax * scale;
+		position_y -= g->ay * scale;
+		if( 0 == g->size_x || 0 == g->size_y )
+			continue;
+		const float x_min = g->offset_x;
+		const float y_min = g->offset_y;
+		const float x_max = g->offset_x + g->size_x / (float)font->texture_width;
+		const float y_max = g->offset_y + g->size_y / (float)font->texture_height;
+		bench_legacy_vertex_t* v = &buffer[*index];
+		vec4f_set( &v[0].coords, x2,		y2 + h,	x_min, y_min );
+		vec4f_set( &v[1].coords, x2,		y2,		x_min, y_max );
+		vec4f_set( &v[2].coords, x2 + w,	y2,		x_max, y_max );
+		vec4f_set( &v[3].coords, x2,		y2 + h,	x_min, y_min );
+		vec4f_set( &v[4].coords, x2 + w,	y2,		x_max, y_max );
+		vec4f_set( &v[5].coords, x2 + w,	y2 + h,	x_max, y_min );
+		for( int j = 0; j < 6; ++j )
+			v[j].layer = layer;
+		*index += 6;
+	}
+}
+
+/* The former scalar instance loop: every glyph's rect and texels from its glyph_info_t.
+ * Kept to compare against the precomputed quads */
+static void bench_scalar_glyph_instances( gui_glyph_t* buffer, GLsizei* index, const char* text,
+		const font_info_t* font, float position_x, float position_y, float scale ) {
+	const GLuint layer = (GLuint)font->atlas_layer;
+	const char* p = text;
+	unsigned int prev = 96;
+	for( unsigned int c = font_utf8_next( &p ); 0 != c; c = font_utf8_next( &p ) ) {
+		const unsigned int k = c - 32;
+		if( prev < 96 && k < 96 )
+			position_x += font->kerning[prev][k] * scale;
+		prev = k;
+		const glyph_info_t* g = font_get_glyph( font, c, false );
+		if( NULL == g )
+			continue;
+		float pen_x = position_x;
+		if( font->subpixel_phases > 1 && k < 96 ) {
+			pen_x = floorf( position_x );
+			unsigned int phase = (unsigned int)( ( position_x - pen_x ) * (float)font->subpixel_phases + 0.5f );
+			if( phase == font->subpixel_phases ) {
+				pen_x += 1.0f;
+				phase = 0;
+			}
+			if( phase > 0 )
+				g = &font->subpixel_glyphs[( phase - 1 ) * 96 + k];
+		}
+		const float x2 = pen_x + g->bearing_x * scale;
+		const float y2 = position_y - ( g->size_y - g->bearing_y ) * scale;
+		const float w = g->size_x * scale;
+		const float h = g->size_y * scale;
+		position_x += g->ax * scale;
+		position_y -= g->ay * scale;
+		if( 0 == g->size_x || 0 == g->size_y )
+			continue;
+		gui_glyph_t* v = &buffer[*index];
+		vec4f_set( &v->rect, x2, y2, w, h );
+		v->texel_rect[0] = (GLushort)( g->offset_x * (float)font->texture_width + 0.5f );
+		v->texel_rect[1] = (GLushort)( g->offset_y * (float)font->texture_height + 0.5f );
+		v->texel_rect[2] = (GLushort)g->size_x;
+		v->texel_rect[3] = (GLushort)g->size_y;
+		v->layer = layer;
+		++*index;
+	}
+}
+
+/* Glyph layout only: the scalar loop versus the precomputed quads, plain and subpixel fonts */
+static void bench_glyph_emit( const char* font_file, unsigned int height ) {
+	const size_t max_glyphs = ( sizeof( BENCH_GLYPH_TEXT ) - 1 ) * BENCH_GLYPH_REPEATS;
+	gui_glyph_t* out[2] = { malloc( max_glyphs * sizeof( gui_glyph_t ) ), malloc( max_glyphs * sizeof( gui_glyph_t ) ) };
+	for( int subpixel = 0; NULL != out[0] && NULL != out[1] && subpixel < 2; ++subpixel ) {
+		font_info_t* font = 0 == subpixel ? font_create( font_file, height ) : font_create_subpixel( font_file, height );
+		if( NULL == font ) {
+			fputs( "glyph_emit: could not create font\n", stderr );
+			break;
+		}
+		GLsizei n[2] = { 0, 0 };
+		for( int path = 0; path < 2; ++path ) {
+			double first = 0.0, total = 0.0;
+			for( int i = 0; i < BENCH_ITERATIONS; ++i ) {
+				const double t0 = bench_now();
+				n[path] = 0;
+				// Fractional positions exercise the subpixel phases
+				for( int r = 0; r < BENCH_GLYPH_REPEATS; ++r ) {
+					const float x = (float)r * 0.37f;
+					if( 0 == path )
+						bench_scalar_glyph_instances( out[path], &n[path], BENCH_GLYPH_TEXT, font, x, (float)r, 1.0f );
+					else
+						glyph_screen_coords( out[path], &n[path], BENCH_GLYPH_TEXT, font, x, (float)r, 1.0f, false, NULL );
+				}
+				const double t = bench_now() - t0;
+				first = 0 == i ? t : first;
+				total += t;
+			}
+			char name[32];
+			snprintf( name, sizeof( name ), "glyph_emit/%s%s", 0 == path ? "scalar" : "quads",
+					0 == subpixel ? "" : "/subpixel" );
+			bench_report( name, first, total, BENCH_ITERATIONS );
+			bench_throughput( (double)n[path], "glyphs" );
+		}
+		const bool same = n[0] == n[1] && 0 == memcmp( out[0], out[1], (size_t)n[0] * sizeof( gui_glyph_t ) );
+		printf( "%-32s %d glyphs, %s, quads %s\n", "", n[1], same ? "identical" : "DIFFERENT",
+				NULL != font->quads ? "used" : "not available" );
+		font_delete( font );
+	}
+	free( out[0] );
+	free( out[1] );
+}
+
+/* Laying out text and uploading it: six vertices per glyph versus one instance */
+static void bench_glyph_upload( const char* font_file, unsigned int height ) {
+	font_info_t* font = font_create( font_file, height );
+	if( NULL == font ) {
+		fputs( "glyph_upload: could not create font\n", stderr );
+		return;
+	}
+	const size_t max_glyphs = ( sizeof( BENCH_GLYPH_TEXT ) - 1 ) * BENCH_GLYPH_REPEATS;
+	const size_t item_size[2] = { 6 * sizeof( bench_legacy_vertex_t ), sizeof( gui_glyph_t ) };
+	void* staging = malloc( max_glyphs * item_size[0] );
+	GLuint buffer;
+	glCreateBuffers( 1, &buffer );
+	glNamedBufferStorage( buffer, (GLsizeiptr)( max_glyphs * item_size[0] ), NULL, GL_DYNAMIC_STORAGE_BIT );
+	for( int path = 0; NULL != staging && path < 2; ++path ) {
+		double first = 0.0, total = 0.0;
+		GLsizei n = 0;
+		for( int i = 0; i < BENCH_ITERATIONS; ++i ) {
+			const double t0 = bench_now();
+			n = 0;
+			for( int r = 0; r < BENCH_GLYPH_REPEATS; ++r ) {
+				if( 0 == path )
+					bench_legacy_glyph_vertices( staging, &n, BENCH_GLYPH_TEXT, font, 0.0f, (float)r, 1.0f );
+				else
+					glyph_screen_coords( staging, &n, BENCH_GLYPH_TEXT, font, 0.0f, (float)r, 1.0f, false, NULL );
+			}
+			const size_t bytes = (size_t)n * ( 0 == path ? sizeof( bench_legacy_vertex_t ) : sizeof( gui_glyph_t ) );
+			glNamedBufferSubData( buffer, 0, (GLsizeiptr)bytes, staging );
+			glFinish();
+			const double t = bench_now() - t0;
+			first = 0 == i ? t : first;
+			total += t;
+		}
+		bench_report( 0 == path ? "glyph_upload/vertices" : "glyph_upload/instances", first, total, BENCH_ITERATIONS );
+		const GLsizei glyphs = 0 == path ? n / 6 : n;
+		printf( "%-32s %zu bytes per glyph, %.3f MB per run\n", "", item_size[path],
+				(double)( (size_t)glyphs * item_size[path] ) * 1e-6 );
+	}
+	glDeleteBuffers( 1, &buffer );
+	free( staging );
+	font_delete( font );
+}
+
+/* Software compositing of a screen full of text into an RGBA8 framebuffer, glyphs at whole
+ * pixels copied from the font's image and scaled ones filtered. Reports glyphs per second */
+static void bench_soft_composite( const char* font_file, unsigned int height ) {
+	font_info_t* font = font_create( font_file, height );
+	gui_soft_framebuffer_t fb = { 0 };
+	const size_t max_glyphs = ( sizeof( BENCH_GLYPH_TEXT ) - 1 ) * BENCH_GLYPH_REPEATS;
+	gui_glyph_t* glyphs = malloc( max_glyphs * sizeof( gui_glyph_t ) );
+	if( NULL == font || NULL == glyphs || !gui_soft_framebuffer_create( &fb, BENCH_SOFT_WIDTH, BENCH_SOFT_HEIGHT ) ) {
+		fputs( "soft_composite: could not set up\n", stderr );
+		free( glyphs );
+		gui_soft_framebuffer_delete( &fb );
+		if( NULL != font )
+			font_delete( font );
+		return;
+	}
+	const vec3f background = { 0.2f, 0.2f, 0.2f };
+	const vec3f color = { 1.0f, 1.0f, 0.5f };
+	const float scales[2] = { 1.0f, 1.5f };
+	for( int path = 0; path < 2; ++path ) {
+		// Lines of text from the top down, the repeats wrap to further columns
+		GLsizei n = 0;
+		const float line = (float)height * scales[path];
+		// At least one line for fonts taller than the framebuffer, it is clipped
+		const int fitting = (int)( (float)BENCH_SOFT_HEIGHT / line ) - 1;
+		const int lines = fitting > 1 ? fitting : 1;
+		for( int r = 0; r < BENCH_GLYPH_REPEATS; ++r ) {
+			const float x = (float)( ( r / lines ) * 97 % BENCH_SOFT_WIDTH );
+			const float y = (float)BENCH_SOFT_HEIGHT - line * (float)( 1 + r % lines );
+			glyph_screen_coords( glyphs, &n, BENCH_GLYPH_TEXT, font, x, y, scales[path], true, NULL );
+		}
+		double first = 0.0, total = 0.0;
+		for( int i = 0; i < BENCH_ITERATIONS; ++i ) {
+			gui_soft_clear( &fb, &background );
+			const double t0 = bench_now();
+			gui_soft_draw_glyphs( &fb, font, glyphs, n, 0.0f, 0.0f, &color, NULL );
+			const double t = bench_now() - t0;
+			first = 0 == i ? t : first;
+			total += t;
+		}
+		bench_report( 0 == path ? "soft_composite/copied" : "soft_composite/filtered", first, total, BENCH_ITERATIONS );
+		bench_throughput( (double)n, "glyphs" );
+	}
+	free( glyphs );
+	gui_soft_framebuffer_delete( &fb );
+	font_delete( font );
+}
+
+/* Formatting variables: snprintf() versus a compiled gui_format_t, and their agreement */
+static void bench_format() {
+	const char* formats[] = { "%7.2f", "%+010.4f", "%9d", "%08X" };
+	float* floats = malloc( BENCH_FORMAT_VALUES * sizeof( float ) );
+	int* ints = malloc( BENCH_FORMAT_VALUES * sizeof( int ) );
+	if( NULL == floats || NULL == ints ) {
+		free( floats );
+		free( ints );
+		return;
+	}
+	// Frame times, counters and large magnitudes
+	srand( 1 );
+	for( int i = 0; i < BENCH_FORMAT_VALUES; ++i ) {
+		floats[i] = (float)( rand() - RAND_MAX / 2 ) / (float)( 1 + rand() % 10000 );
+		ints[i] = ( rand() - RAND_MAX / 2 ) >> ( i % 24 );
+	}
+	char a[MAX_GUI_ELEMENT_LENGTH], b[MAX_GUI_ELEMENT_LENGTH];
+	for( size_t k = 0; k < sizeof( formats ) / sizeof( formats[0] ); ++k ) {
+		gui_format_t f;
+		if( !gui_format_compile( &f, formats[k] ) )
+			continue;
+		const bool is_float = gui_format_is_float( &f );
+		// Keeps the results alive
+		size_t chars = 0;
+		for( int path = 0; path < 2; ++path ) {
+			double first = 0.0, total = 0.0;
+			for( int i = 0; i < BENCH_ITERATIONS; ++i ) {
+				const double t0 = bench_now();
+				for( int v = 0; v < BENCH_FORMAT_VALUES; ++v ) {
+					if( 0 == path )
+						chars += (size_t)( is_float ? snprintf( a, sizeof( a ), formats[k], floats[v] ) :
+								snprintf( a, sizeof( a ), formats[k], ints[v] ) );
+					else
+						chars += (size_t)( is_float ? gui_format_float( &f, floats[v], a, sizeof( a ) ) :
+								gui_format_int( &f, ints[v], a, sizeof( a ) ) );
+				}
+				const double t = bench_now() - t0;
+				first = 0 == i ? t : first;
+				total += t;
+			}
+			char name[32];
+			snprintf( name, sizeof( name ), "format/%s/%s", 0 == path ? "snprintf" : "plan", formats[k] );
+			bench_report( name, first, total, BENCH_ITERATIONS );
+			bench_throughput( BENCH_FORMAT_VALUES, "values" );
+		}
+		int mismatches = 0;
+		for( int v = 0; v < BENCH_FORMAT_VALUES; ++v ) {
+			if( is_float ) {
+				snprintf( a, sizeof( a ), formats[k], floats[v] );
+				gui_format_float( &f, floats[v], b, sizeof( b ) );
+			} else {
+				snprintf( a, sizeof( a ), formats[k], ints[v] );
+				gui_format_int( &f, ints[v], b, sizeof( b ) );
+			}
+			mismatches += 0 != strcmp( a, b );
+		}
+		printf( "%-32s %d values, %d differ from snprintf (%zu chars)\n", "", BENCH_FORMAT_VALUES, mismatches, chars );
+	}
+	free( floats );
+	free( ints );
+}
+
+/* Formatting and laying out the variables of a window that all change every frame */
+static void bench_window_update( const char* font_file, unsigned int height ) {
+	font_info_t* font = font_create( font_file, height );
+	gui_window_t* w = NULL == font ? NULL :
+			gui_window_create( "bench", font, 0, BENCH_SOFT_HEIGHT - 1, (float)BENCH_SOFT_WIDTH, (float)BENCH_SOFT_HEIGHT );
+	float floats[BENCH_UPDATE_VARIABLES / 2];
+	int ints[BENCH_UPDATE_VARIABLES / 2];
+	bool ok = NULL != w && gui_window_begin( w );
+	const char* formats[4] = { "%7.2f", "%9d", "%+010.4f", "%08X" };
+	for( int v = 0; ok && v < BENCH_UPDATE_VARIABLES; ++v ) {
+		const float x = (float)( v % 8 ) * 150.0f;
+		const float y = (float)( v / 8 + 1 ) * (float)( height + 1 );
+		const bool is_float = 0 == v % 2;
+		ok = gui_window_add_variable( w, is_float ? gui_float : gui_int,
+				is_float ? (void*)&floats[v / 2] : (void*)&ints[v / 2], formats[v % 4], x, y );
+	}
+	ok = ok && gui_window_end( w );
+	if( ok ) {
+		double first = 0.0, total = 0.0;
+		for( int i = 0; i < BENCH_ITERATIONS; ++i ) {
+			const double t0 = bench_now();
+			for( int f = 0; f < BENCH_UPDATE_FRAMES; ++f ) {
+				const int frame = i * BENCH_UPDATE_FRAMES + f;
+				for( int v = 0; v < BENCH_UPDATE_VARIABLES / 2; ++v ) {
+					floats[v] = (float)( frame * 7 + v ) * 0.37f;
+					ints[v] = frame * 131 + v;
+				}
+				gui_window_update( w );
+			}
+			const double t = bench_now() - t0;
+			first = 0 == i ? t : first;
+			total += t;
+		}
+		bench_report( "window_update", first, total, BENCH_ITERATIONS );
+		bench_throughput( BENCH_UPDATE_VARIABLES * BENCH_UPDATE_FRAMES, "variables" );
+	} else
+		fputs( "window_update: could not create window\n", stderr );
+	if( NULL != w )
+		gui_window_delete( w );
+	if( NULL != font )
+		font_delete( font );
+}
+
+/* The omath kernels on arrays of random operands */
+static void bench_math() {
+	mat4f* a = malloc( BENCH_MATH_COUNT * sizeof( mat4f ) );
+	mat4f* b = malloc( BENCH_MATH_COUNT * sizeof( mat4f ) );
+	mat4f* m = malloc( BENCH_MATH_COUNT * sizeof( mat4f ) );
+	vec3f* v = malloc( BENCH_MATH_COUNT * sizeof( vec3f ) );
+	vec3f* n = malloc( BENCH_MATH_COUNT * sizeof( vec3f ) );
+	if( NULL != a && NULL != b && NULL != m && NULL != v && NULL != n ) {
+		srand( 2 );
+		for( int i = 0; i < BENCH_MATH_COUNT; ++i ) {
+			for( int j = 0; j < 16; ++j ) {
+				a[i].data[j] = (float)rand() / (float)RAND_MAX - 0.5f;
+				b[i].data[j] = (float)rand() / (float)RAND_MAX - 0.5f;
+			}
+			v[i].x = (float)rand() / (float)RAND_MAX - 0.5f;
+			v[i].y = (float)rand() / (float)RAND_MAX - 0.5f;
+			v[i].z = (float)rand() / (float)RAND_MAX + 0.1f;
+		}
+		const char* names[3] = { "math/mat4f_mul", "math/mat4f_inverse", "math/vec3f_normalize" };
+		// Keeps the results alive
+		float sum = 0.0f;
+		for( int kernel = 0; kernel < 3; ++kernel ) {
+			double first = 0.0, total = 0.0;
+			for( int i = 0; i < BENCH_ITERATIONS; ++i ) {
+				const double t0 = bench_now();
+				for( int k = 0; k < BENCH_MATH_COUNT; ++k ) {
+					if( 0 == kernel )
+						mat4f_mul( &m[k], &a[k], &b[k] );
+					else if( 1 == kernel )
+						mat4f_inverse( &m[k], &a[k] );
+					else
+						vec3f_normalize( &n[k], &v[k] );
+				}
+				const double t = bench_now() - t0;
+				first = 0 == i ? t : first;
+				total += t;
+				sum += 2 == kernel ? n[i].x : m[i].data[i % 16];
+			}
+			bench_report( names[kernel], first, total, BENCH_ITERATIONS );
+			bench_throughput( BENCH_MATH_COUNT, "ops" );
+		}
+		printf( "%-32s checksum %g\n", "", (double)sum );
+	}
+	free( a );
+	free( b );
+	free( m );
+	free( v );
+	free( n );
+}
+
+static bool bench_write_json( const char* filename ) {
+	FILE* f = fopen( filename, "w" );
+	if( NULL == f ) {
+		fprintf( stderr, "Could not open '%s' for writing\n", filename );
+		return false;
+	}
+	// One benchmark per line, -compare reads them back line by line
+	fputs( "{\n\t\"benchmarks\": [\n", f );
+	for( int i = 0; i < num_results; ++i )
+		fprintf( f, "\t\t{ \"name\": \"%s\", \"first_ms\": %.6f, \"mean_ms\": %.6f, \"runs\": %d, \"per_second\": %.1f }%s\n",
+				results[i].name, results[i].first_ms, results[i].mean_ms, results[i].runs, results[i].per_second,
+				i + 1 < num_results ? "," : "" );
+	fputs( "\t]\n}\n", f );
+	if( 0 != fclose( f ) ) {
+		fprintf( stderr, "Error writing '%s'\n", filename );
+		return false;
+	}
+	printf( "%d results written to %s\n", num_results, filename );
+	return true;
+}
+
+/* Reads results written by bench_write_json(). -1 on failure or if the file holds none */
+static int bench_read_json( const char* filename, bench_result_t* out, int max ) {
+	FILE* f = fopen( filename, "r" );
+	if( NULL == f ) {
+		fprintf( stderr, "Could not open '%s' for reading\n", filename );
+		return -1;
+	}
+	char line[256];
+	int n = 0;
+	while( n < max && NULL != fgets( line, sizeof( line ), f ) ) {
+		bench_result_t* r = &out[n];
+		if( 5 == sscanf( line, " { \"name\": \"%47[^\"]\", \"first_ms\": %lf, \"mean_ms\": %lf, \"runs\": %d, \"per_second\": %lf",
+				r->name, &r->first_ms, &r->mean_ms, &r->runs, &r->per_second ) )
+			++n;
+	}
+	fclose( f );
+	if( 0 == n ) {
+		fprintf( stderr, "No benchmark results in '%s'\n", filename );
+		return -1;
+	}
+	return n;
+}
+
+/* Compares mean times of two result files, true if none regressed by more than tolerance percent
+ * and every baseline benchmark ran again */
+static bool bench_compare( const char* baseline_file, const char* current_file, double tolerance ) {
+	static bench_result_t baseline[BENCH_MAX_RESULTS];
+	const int num_baseline = bench_read_json( baseline_file, baseline, BENCH_MAX_RESULTS );
+	num_results = bench_read_json( current_file, results, BENCH_MAX_RESULTS );
+	if( num_baseline < 0 || num_results < 0 )
+		return false;
+	int regressions = 0;
+	printf( "%-32s %12s %12s %9s\n", "", "baseline ms", "current ms", "change" );
+	for( int i = 0; i < num_results; ++i ) {
+		const bench_result_t* r = &results[i];
+		int b = 0;
+		while( b < num_baseline && 0 != strcmp( baseline[b].name, r->name ) )
+			++b;
+		if( b == num_baseline ) {
+			printf( "%-32s %12s %12.3f %9s\n", r->name, "-", r->mean_ms, "new" );
+			continue;
+		}
+		const double change = baseline[b].mean_ms > 0.0 ? ( r->mean_ms / baseline[b].mean_ms - 1.0 ) * 100.0 : 0.0;
+		const bool regressed = change > tolerance;
+		regressions += regressed;
+		printf( "%-32s %12.3f %12.3f %+8.1f%%%s\n", r->name, baseline[b].mean_ms, r->mean_ms, change,
+				regressed ? "  REGRESSION" : change < -tolerance ? "  faster" : "" );
+	}
+	// A benchmark that did not run, e.g. without a GL context, must not pass silently
+	int missing = 0;
+	for( int b = 0; b < num_baseline; ++b ) {
+		int i = 0;
+		while( i < num_results && 0 != strcmp( results[i].name, baseline[b].name ) )
+			++i;
+		if( i == num_results ) {
+			printf( "%-32s %12.3f %12s %9s\n", baseline[b].name, baseline[b].mean_ms, "-", "MISSING" );
+			++missing;
+		}
+	}
+	printf( "%d of %d benchmarks slower by more than %.1f%%, %d missing\n", regressions, num_results, tolerance,
+			missing );
+	return 0 == regressions && 0 == missing;
+}
+
+int main( int argc, char** argv ) {
+	if( argc > 3 && 0 == strcmp( argv[1], "-compare" ) ) {
+		const double tolerance = argc > 4 ? atof( argv[4] ) : BENCH_DEFAULT_TOLERANCE;
+		return bench_compare( argv[2], argv[3], tolerance ) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	const char* json_file = NULL;
+	int arg = 1;
+	if( arg + 1 < argc && 0 == strcmp( argv[arg], "-json" ) ) {
+		json_file = argv[arg + 1];
+		arg += 2;
+	}
+	if( arg < argc && '-' == argv[arg][0] ) {
+		fputs( "Usage: bench [-json <results file>] [<font file> [height]]\n"
+				"       bench -compare <baseline results> <results> [tolerance in percent]\n", stderr );
+		return EXIT_FAILURE;
+	}
+	const char* font_file = arg < argc ? argv[arg] : NULL;
+	const unsigned int height = arg + 1 < argc ? (unsigned int)atoi( argv[arg + 1] ) : 14;
+	// Without GL
+	bench_math();
+	bench_format();
+	if( NULL == font_file )
+		puts( "No font file, skipping the font and rendering benchmarks" );
+	else if( !glfwInit() )
+		fputs( "glfwInit() failed, skipping the font and rendering benchmarks\n", stderr );
+	else {
+		glfwWindowHint( GLFW_CONTEXT_VERSION_MAJOR, 4 );
+		glfwWindowHint( GLFW_CONTEXT_VERSION_MINOR, 5 );
+		glfwWindowHint( GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE );
+		glfwWindowHint( GLFW_VISIBLE, GLFW_FALSE );
+		GLFWwindow* win = glfwCreateWindow( 16, 16, "bench", NULL, NULL );
+		if( NULL != win ) {
+			glfwMakeContextCurrent( win );
+			if( gladLoadGL() ) {
+				bench_font_startup( font_file, height );
+				bench_font_upload( font_file, height );
+				bench_glyph_upload( font_file, height );
+				bench_glyph_emit( font_file, height );
+				bench_window_update( font_file, height );
+				bench_soft_composite( font_file, height );
+			} else
+				fputs( "gladLoadGL() failed, skipping the font and rendering benchmarks\n", stderr );
+			glfwDestroyWindow( win );
+		} else
+			fputs( "glfwCreateWindow() failed, skipping the font and rendering benchmarks\n", stderr );
+		glfwTerminate();
+	}
+	if( NULL != json_file && !bench_write_json( json_file ) )
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
@@ -5,6 +5,8 @@
 #include <GLFW/glfw3.h>
 #include <string.h>
 #include "src/gui_window.h"
+#include "src/gl_state.h"
+#include "src/gui_stats.h"
 #include "omath/vec3f.h"
 
 #define WINDOW_WIDTH 1600
@@ -36,19 +38,34 @@ int main( void ) {
     		gui_window_add_static_text( gui_window, "Framerate:", 1.0f, (float)FONT_HEIGHT + 1.0f );
     		gui_window_add_static_text( gui_window, "Frame #:", 1.0f, 2.0f * ((float)FONT_HEIGHT + 1.0f) );
     		float framerate = 0.0f;
-    		gui_window_add_variable( gui_window, gui_float, &framerate, 80.0f, (float)FONT_HEIGHT + 1.0f );
+    		gui_window_add_variable( gui_window, gui_float, &framerate, "%7.2f", 80.0f, (float)FONT_HEIGHT + 1.0f );
     		unsigned int frame_counter = 0;
-    		gui_window_add_variable( gui_window, gui_int, &frame_counter, 80.0f, 2.0f * ((float)FONT_HEIGHT + 1.0f) );
+    		gui_window_add_variable( gui_window, gui_int, &frame_counter, "%9d", 80.0f, 2.0f * ((float)FONT_HEIGHT + 1.0f) );
     	gui_window_end( gui_window );
+    	// Cost of the gui itself, below the window
+    	const int stats_offset = 3 * ( FONT_HEIGHT + 1 );
+    	gui_stats_t* stats = gui_stats_create( draw_font, 1, WINDOW_HEIGHT - 1 - stats_offset,
+    			(float)WINDOW_WIDTH, (float)WINDOW_HEIGHT );
 
     	glEnable( GL_CULL_FACE );
     	double last_frame = 0.01;
+    	int last_height = WINDOW_HEIGHT;
     	puts( "Entering main loop ..." );
     	while( !glfwWindowShouldClose( win ) ) {
     		const double this_frame = glfwGetTime();
     		framerate = 1.0f / (float)( this_frame - last_frame );
     		last_frame = this_frame;
-    		glUseProgram( 0 );
+    		// The gui follows the framebuffer size, the window stays in the upper left corner
+    		int fb_width, fb_height;
+    		glfwGetFramebufferSize( win, &fb_width, &fb_height );
+    		glViewport( 0, 0, fb_width, fb_height );
+    		gui_resize( (float)fb_width, (float)fb_height );
+    		if( fb_height != last_height ) {
+    			gui_window_move( gui_window, 1, fb_height - 1 );
+    			if( NULL != stats )
+    				gui_window_move( stats->window, 1, fb_height - 1 - stats_offset );
+    			last_height = fb_height;
+    		}
     		// Clear the colorbuffer
     		glClearColor( 0.3f, 0.3f, 0.3f, 1.0f );
     		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
@@ -57,12 +74,22 @@ int main( void ) {
     		vec3f col1 = { 1.0f, 1.0f, 1.0f };
     		gui_window_update( gui_window );
     		gui_window_render( gui_window, &col1 );
+    		if( NULL != stats ) {
+    			gui_window_update( stats->window );
+    			gui_window_render( stats->window, &col1 );
+    			gui_stats_frame( stats );
+    		}
     		//render_texture_atlas();
     		frame_counter++;
     		glfwPollEvents();
     		glfwSwapBuffers( win );
     	}
     	puts( "... leaving main loop" );
+    	gl_state_stats_t state_stats;
+    	gl_state_stats( &state_stats );
+    	printf( "GL state changes: %lu requested, %lu skipped\n", state_stats.calls, state_stats.skipped );
+    	if( NULL != stats )
+    		gui_stats_delete( stats );
     	gui_window_delete( gui_window );
     	font_delete( draw_font );
     	glfwDestroyWindow( win );
@@ -0,0 +1,141 @@
+
+#include "atlas_packer.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int atlas_packer_fit( const atlas_packer_t* p, int index, int width, int height );
+
+bool atlas_packer_init( atlas_packer_t* p, int width, int height, int padding ) {
+	p->width = width;
+	p->height = height;
+	p->padding = padding;
+	p->used_area = 0;
+	// Worst case every pixel column becomes a node of its own
+	p->max_nodes = width + 1;
+	p->nodes = malloc( (size_t)p->max_nodes * sizeof( atlas_packer_node_t ) );
+	if( NULL == p->nodes )
+		return false;
+	// Start one padding away from the upper and left edges
+	p->num_nodes = 1;
+	p->nodes[0].x = padding;
+	p->nodes[0].y = padding;
+	p->nodes[0].width = width - padding;
+	return true;
+}
+
+bool atlas_packer_add( atlas_packer_t* p, int width, int height, int* out_x, int* out_y ) {
+	const int w = width + p->padding;
+	const int h = height + p->padding;
+	int best_index = -1;
+	int best_y = p->height;
+	int best_waste = p->width;
+	for( int i = 0; i < p->num_nodes; ++i ) {
+		const int y = atlas_packer_fit( p, i, w, h );
+		if( y < 0 )
+			continue;
+		const int waste = p->nodes[i].width - w;
+		if( y < best_y || ( y == best_y && waste < best_waste ) ) {
+			best_index = i;
+			best_y = y;
+			best_waste = waste;
+		}
+	}
+	if( best_index < 0 || p->num_nodes >= p->max_nodes )
+		return false;
+	// Insert the new segment on top of the rectangle
+	const atlas_packer_node_t n = { p->nodes[best_index].x, best_y + h, w };
+	memmove( &p->nodes[best_index + 1], &p->nodes[best_index],
+			(size_t)( p->num_nodes - best_index ) * sizeof( atlas_packer_node_t ) );
+	p->nodes[best_index] = n;
+	++p->num_nodes;
+	// Shrink or remove the segments now covered by the new one
+	for( int i = best_index + 1; i < p->num_nodes; ++i ) {
+		atlas_packer_node_t* prev = &p->nodes[i - 1];
+		atlas_packer_node_t* cur = &p->nodes[i];
+		if( cur->x >= prev->x + prev->width )
+			break;
+		const int shrink = prev->x + prev->width - cur->x;
+		cur->x += shrink;
+		cur->width -= shrink;
+		if( cur->width > 0 )
+			break;
+		memmove( cur, cur + 1, (size_t)( p->num_nodes - i - 1 ) * sizeof( atlas_packer_node_t ) );
+		--p->num_nodes;
+		--i;
+	}
+	// Merge neighbours of equal height
+	for( int i = 0; i < p->num_nodes - 1; ++i ) {
+		if( p->nodes[i].y == p->nodes[i + 1].y ) {
+			p->nodes[i].width += p->nodes[i + 1].width;
+			memmove( &p->nodes[i + 1], &p->nodes[i + 2],
+					(size_t)( p->num_nodes - i - 2 ) * sizeof( atlas_packer_node_t ) );
+			--p->num_nodes;
+			--i;
+		}
+	}
+	p->used_area += (long)width * (long)height;
+	*out_x = n.x;
+	*out_y = best_y;
+	return true;
+}
+
+bool atlas_packer_grow( atlas_packer_t* p, int width, int height ) {
+	if( width > p->width ) {
+		atlas_packer_node_t* nodes = realloc( p->nodes, (size_t)( width + 1 ) * sizeof( atlas_packer_node_t ) );
+		if( NULL == nodes )
+			return false;
+		p->nodes = nodes;
+		p->max_nodes = width + 1;
+		// Rectangles keep one padding away from the old right edge, the new segment starts there
+		atlas_packer_node_t* last = &p->nodes[p->num_nodes - 1];
+		if( last->y == p->padding )
+			last->width += width - p->width;
+		else {
+			const atlas_packer_node_t n = { p->width, p->padding, width - p->width };
+			p->nodes[p->num_nodes++] = n;
+		}
+		p->width = width;
+	}
+	if( height > p->height )
+		p->height = height;
+	return true;
+}
+
+int atlas_packer_used_height( const atlas_packer_t* p ) {
+	int h = 0;
+	for( int i = 0; i < p->num_nodes; ++i )
+		h = p->nodes[i].y > h ? p->nodes[i].y : h;
+	return h;
+}
+
+float atlas_packer_efficiency( const atlas_packer_t* p ) {
+	const int h = atlas_packer_used_height( p );
+	if( 0 == h )
+		return 0.0f;
+	return (float)p->used_area / ( (float)p->width * (float)h );
+}
+
+void atlas_packer_delete( atlas_packer_t* p ) {
+	if( NULL != p->nodes )
+		free( p->nodes );
+	p->nodes = NULL;
+	p->num_nodes = p->max_nodes = 0;
+}
+
+// Returns the y position of a width * height rectangle starting at node index, or -1 if it does not fit
+static int atlas_packer_fit( const atlas_packer_t* p, int index, int width, int height ) {
+	const int x = p->nodes[index].x;
+	if( x + width > p->width )
+		return -1;
+	int y = 0;
+	int remaining = width;
+	for( int i = index; remaining > 0; ++i ) {
+		if( i >= p->num_nodes )
+			return -1;
+		y = p->nodes[i].y > y ? p->nodes[i].y : y;
+		if( y + height > p->height )
+			return -1;
+		remaining -= p->nodes[i].width;
+	}
+	return y;
+}
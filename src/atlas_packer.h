@@ -0,0 +1,49 @@
+/*
+ * Skyline bottom-left rectangle packer for glyph atlases.
+ * The skyline is a list of horizontal segments describing the top edge of the
+ * area that has been used so far. A new rectangle is placed on the segment that
+ * keeps it lowest, ties are broken by the narrowest waste.
+ * http://clb.demon.fi/files/RectangleBinPack.pdf
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+typedef struct {
+	int x;
+	int y;
+	int width;
+} atlas_packer_node_t;
+
+typedef struct {
+	int width;
+	int height;
+	// Empty border in pixels around every rectangle, avoids bleeding with linear filtering
+	int padding;
+	int num_nodes;
+	int max_nodes;
+	atlas_packer_node_t* nodes;
+	// Sum of the areas of all rectangles packed, without padding
+	long used_area;
+} atlas_packer_t;
+
+/* Initializes an empty packer for an area of width * height pixels.
+ * Returns false if memory for the skyline could not be allocated */
+bool atlas_packer_init( atlas_packer_t* p, int width, int height, int padding );
+
+/* Finds a place for a rectangle of width * height pixels, padding is added internally.
+ * Returns false if the rectangle does not fit, out_x/out_y are the upper left corner */
+bool atlas_packer_add( atlas_packer_t* p, int width, int height, int* out_x, int* out_y );
+
+/* Enlarges the area to width * height pixels, packed rectangles keep their place.
+ * The new columns on the right start empty. Returns false if memory could not be allocated */
+bool atlas_packer_grow( atlas_packer_t* p, int width, int height );
+
+/* Lowest y coordinate not yet touched by the skyline */
+int atlas_packer_used_height( const atlas_packer_t* p );
+
+/* Ratio of packed area to area of the rows used so far, [0-1] */
+float atlas_packer_efficiency( const atlas_packer_t* p );
+
+void atlas_packer_delete( atlas_packer_t* p );
@@ -1,127 +1,690 @@
 
 #include "font.h"
-#include <ft2build.h>
-#include FT_FREETYPE_H
+#include "glyph_cache.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <fcntl.h>		// open()
+#include <unistd.h>		// close()
+#include <sys/mman.h>	// mmap()
+#include <sys/stat.h>
+#include "atlas_packer.h"
+#include "sdf.h"
+#include "font_raster.h"
+#include "font_registry.h"
+#include "font_atlas.h"
 #include "omath/vec4f.h"
 #include "shader_program.h"
 
-static FT_Library ft = NULL;
-static FT_Face face = NULL;
+// Baked font file: header, glyph_info_t[96], subpixel glyph_info_t[( subpixel_phases - 1 ) * 96],
+// preloaded glyph_info_t[num_glyphs - subpixel_phases * 96], float kerning[96][96],
+// atlas pixels (R8, row by row from the top)
+#define FONT_BAKED_MAGIC "VVSF"
+#define FONT_BAKED_VERSION 5
 
-static bool font_init_and_check( const char* filename );
-static void font_cleanup();
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	// Guards against a changed glyph_info_t layout
+	uint32_t glyph_size;
+	uint32_t num_glyphs;
+	uint32_t height;
+	uint32_t texture_width;
+	uint32_t texture_height;
+	float packing_efficiency;
+	uint32_t sdf_spread;
+	uint32_t subpixel_phases;
+	// Offset of the pixels from the start of the file
+	uint32_t pixel_offset;
+} font_baked_header_t;
+
+// Cell grid of the glyph cache page below the packed glyphs
+typedef struct {
+	int origin_y;
+	int cell_width;
+	int cell_height;
+	int columns;
+	int rows;
+} font_cache_layout_t;
+
+static void font_create_failed( font_info_t* font_info, font_bitmap_t* bitmaps, unsigned int count,
+		font_face_t* face, FT_Size size );
+static bool font_pack_bitmaps( font_info_t* font_info, font_bitmap_t* bitmaps, unsigned int count );
+static void font_layout_cache( font_info_t* font_info, FT_Face face, font_cache_layout_t* layout );
+static void font_fill_kerning( font_info_t* font_info, FT_Face face );
+static void font_attach_cache( font_info_t* font_info, const font_cache_layout_t* layout,
+		font_face_t* face, FT_Size size, const char* filename );
+static bool font_upload( font_info_t* font_info, unsigned char* pixels,
+		unsigned int width, unsigned int height );
+static void font_atlas_resized( unsigned int old_size, unsigned int size );
+static void font_destroy( font_info_t* font_info );
+static void font_build_quads( font_info_t* font_info );
+static glyph_info_t* font_preloaded_glyph( const font_info_t* font_info, unsigned int index );
+static unsigned int font_num_preloaded_glyphs( const font_info_t* font_info );
+static const glyph_info_t* font_find_extra_glyph( const font_info_t* font, unsigned int codepoint );
+
+// Fonts with a rectangle in the atlas, renormalized when the layers grow
+static font_info_t** atlas_fonts = NULL;
+static unsigned int num_atlas_fonts = 0;
+static unsigned int atlas_fonts_capacity = 0;
 
-/* https://en.wikibooks.org/wiki/OpenGL_Programming/Modern_OpenGL_Tutorial_Text_Rendering_02
- * and https://learnopengl.com/code_viewer.php?code=in-practice/text_rendering */
 font_info_t* font_create( const char* const filename, unsigned int height ) {
-	if( font_init_and_check( filename ) ) {
-		font_info_t* font_info = malloc( sizeof( font_info_t ) );
-		if( NULL != font_info ) {
-			font_info->height = height;
-			if( height < 6 || height > 36 ) {
-				fputs( "Font height must be [6-36], for now\n", stderr );
-				return false;
-			}
-			// @todo check return code 0 == success
-			FT_Set_Pixel_Sizes( face, 0, font_info->height );
-			FT_GlyphSlot g = face->glyph;
-			memset( font_info->glyphs, 0, sizeof( font_info->glyphs ) );
-			font_info->texture_width = font_info->texture_height = 0;
-			// Pass 1: determine total width and height of texture
-			for( unsigned int i = 32; i < 128; ++i ) {
-				if( FT_Load_Char( face, i, FT_LOAD_RENDER ) )
-					continue;
-				font_info->texture_width += g->bitmap.width;
-				// Multiline not implemented, all glyphs are in one row. That limits the size of the glyphs
-				font_info->texture_height =
-						font_info->texture_height > g->bitmap.rows ? font_info->texture_height : g->bitmap.rows;
-			}
-			// Disable byte-alignment restriction to store the texture
-			GLint upa;
-			glGetIntegerv( GL_UNPACK_ALIGNMENT, &upa );
-			glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
-			printf( "Loading font '%s'\n", filename );
-			// Create font atlas and set default texture parameters
-			glCreateTextures( GL_TEXTURE_2D, 1, &font_info->texture_atlas );
-			glTextureParameteri( font_info->texture_atlas, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-			glTextureParameteri( font_info->texture_atlas, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
-			glTextureParameteri( font_info->texture_atlas, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-			glTextureParameteri( font_info->texture_atlas, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-			glTextureStorage2D(
-					font_info->texture_atlas, 1, GL_R8, (GLsizei)font_info->texture_width, (GLsizei)font_info->texture_height
-			);
-			// Pass 2 : load glyphs at current texture offset position, y for multiline (not implemented)
-			int offset_x = 0;
-			int offset_y = 0;
-			for( GLubyte i = 32; i < 128; ++i ) {
-				if( FT_Load_Char( face, i, FT_LOAD_RENDER ) ) {
-					fprintf( stderr, "Failed to load glyph #%d, char '%c'\n", i, i );
-					continue;
-				}
-				int idx = i - 32;
-				//printf( "Loading glyph %d\t'%c'\n", i, i );
-				glTextureSubImage2D( font_info->texture_atlas, 0, offset_x, 0/*offset_y*/,
-						(GLsizei)g->bitmap.width, (GLsizei)g->bitmap.rows, GL_RED, GL_UNSIGNED_BYTE, g->bitmap.buffer );
-				font_info->glyphs[idx].code = (char)i;
-				font_info->glyphs[idx].ax = (float)(g->advance.x >> 6);
-				font_info->glyphs[idx].ay = (float)(g->advance.y >> 6);
-				font_info->glyphs[idx].size_x = (float)g->bitmap.width;
-				font_info->glyphs[idx].size_y = (float)g->bitmap.rows;
-				font_info->glyphs[idx].bearing_x = (float)g->bitmap_left;
-				font_info->glyphs[idx].bearing_y = (float)g->bitmap_top;
-				font_info->glyphs[idx].offset_x = (float)offset_x / (float)font_info->texture_width;
-				font_info->glyphs[idx].offset_y = (float)offset_y / (float)font_info->texture_height;
-				// Offset for next glyph
-				offset_x += (int)g->bitmap.width;
-			}
-			// cleanup
-			glPixelStorei( GL_UNPACK_ALIGNMENT, upa );
-			font_cleanup();
-			// positive outcome
-			return font_info;
+	return font_create_range( filename, height, false, 1, 32, 127, 1 );
+}
+
+font_info_t* font_create_sdf( const char* const filename, unsigned int height ) {
+	return font_create_range( filename, height, true, 1, 32, 127, 1 );
+}
+
+font_info_t* font_create_subpixel( const char* const filename, unsigned int height ) {
+	return font_create_range( filename, height, false, FONT_SUBPIXEL_PHASES, 32, 127, 1 );
+}
+
+/* Every glyph is rendered once into a CPU bitmap that keeps its metrics, the bitmaps are
+ * packed and composed into a staging image, and the atlas is uploaded with a single call.
+ * https://en.wikibooks.org/wiki/OpenGL_Programming/Modern_OpenGL_Tutorial_Text_Rendering_02
+ * and https://learnopengl.com/code_viewer.php?code=in-practice/text_rendering */
+font_info_t* font_create_range( const char* const filename, unsigned int height, bool sdf,
+		unsigned int subpixel_phases, unsigned int first_codepoint, unsigned int last_codepoint,
+		unsigned int num_threads ) {
+	if( 0 == height || first_codepoint > last_codepoint || subpixel_phases > 64 ) {
+		fputs( "Font height must be > 0, the codepoint range must not be empty and subpixel phases <= 64\n", stderr );
+		return NULL;
+	}
+	// Distance fields are sampled at any offset anyway
+	const unsigned int phases = sdf || subpixel_phases < 1 ? 1 : subpixel_phases;
+	// Identical requests share one font
+	font_info_t* font_info = font_registry_find_font( filename, height, sdf, phases, first_codepoint, last_codepoint );
+	if( NULL != font_info )
+		return font_info;
+	// ASCII lives in glyphs[] and is always there
+	const unsigned int first = first_codepoint < 32 ? first_codepoint : 32;
+	const unsigned int last = last_codepoint > 127 ? last_codepoint : 127;
+	const unsigned int count = last - first + 1;
+	// Subpixel variants follow the range, one range per phase
+	const unsigned int total = count * phases;
+	const unsigned int sdf_spread = sdf ? FONT_SDF_SPREAD : 0;
+	font_face_t* face = font_registry_acquire_face( filename );
+	if( NULL == face )
+		return NULL;
+	// The face is shared with other sizes and threads, this font gets its own size object
+	font_face_lock( face, NULL );
+	FT_Size size = font_face_new_size( face, height );
+	font_bitmap_t* bitmaps = calloc( total, sizeof( font_bitmap_t ) );
+	font_info = calloc( 1, sizeof( font_info_t ) );
+	if( NULL != font_info && phases > 1 )
+		font_info->subpixel_glyphs = calloc( ( phases - 1 ) * 96, sizeof( glyph_info_t ) );
+	if( NULL == size || NULL == bitmaps || NULL == font_info || ( phases > 1 && NULL == font_info->subpixel_glyphs ) ||
+			!font_raster_range( face->face, face->data, face->data_size, height, sdf_spread, phases,
+					first, last, num_threads, bitmaps ) ) {
+		fprintf( stderr, "Failed to rasterize glyphs of font '%s'\n", filename );
+		font_face_unlock( face );
+		font_create_failed( font_info, bitmaps, total, face, size );
+		return NULL;
+	}
+	font_info->height = height;
+	font_info->sdf_spread = sdf_spread;
+	font_info->subpixel_phases = phases;
+	unsigned int num_extra = 0;
+	for( unsigned int i = 0; i < count; ++i )
+		if( 0 != bitmaps[i].code && ( bitmaps[i].code < 32 || bitmaps[i].code > 127 ) )
+			++num_extra;
+	if( num_extra > 0 )
+		font_info->extra_glyphs = malloc( num_extra * sizeof( glyph_info_t ) );
+	font_cache_layout_t cache_layout;
+	if( ( num_extra > 0 && NULL == font_info->extra_glyphs ) || !font_pack_bitmaps( font_info, bitmaps, total ) ) {
+		font_face_unlock( face );
+		font_create_failed( font_info, bitmaps, total, face, size );
+		return NULL;
+	}
+	font_layout_cache( font_info, face->face, &cache_layout );
+	font_fill_kerning( font_info, face->face );
+	font_face_unlock( face );
+	// Packed size with the cache page, the font's rectangle in the atlas
+	const unsigned int width = font_info->texture_width;
+	const unsigned int height_used = font_info->texture_height;
+	// Compose all glyphs in a staging image, the padding stays 0. Offsets are in texels of the
+	// image until font_upload() places it
+	unsigned char* staging = calloc( (size_t)width * height_used, 1 );
+	if( NULL == staging ) {
+		fputs( "Out of memory for the font atlas staging image\n", stderr );
+		font_create_failed( font_info, bitmaps, total, face, size );
+		return NULL;
+	}
+	for( unsigned int i = 0; i < total; ++i ) {
+		const font_bitmap_t* b = &bitmaps[i];
+		if( 0 == b->code )
+			continue;
+		for( int y = 0; y < b->height; ++y )
+			memcpy( staging + (size_t)( b->y + y ) * width + b->x,
+					b->pixels + y * b->width, (size_t)b->width );
+		const unsigned int phase = i / count;
+		glyph_info_t* gi = phase > 0 ? &font_info->subpixel_glyphs[( phase - 1 ) * 96 + b->code - 32] :
+				b->code >= 32 && b->code < 128 ?
+				&font_info->glyphs[b->code - 32] : &font_info->extra_glyphs[font_info->num_extra_glyphs++];
+		gi->code = b->code;
+		gi->ax = b->ax;
+		gi->ay = b->ay;
+		gi->size_x = (float)b->width;
+		gi->size_y = (float)b->height;
+		gi->bearing_x = (float)b->left;
+		gi->bearing_y = (float)b->top;
+		gi->offset_x = (float)b->x;
+		gi->offset_y = (float)b->y;
+	}
+	font_raster_free( bitmaps, total );
+	free( bitmaps );
+	printf( "Loading font '%s'\n", filename );
+	// The staging image stays with the font as its CPU image
+	if( !font_upload( font_info, staging, width, height_used ) ) {
+		free( staging );
+		font_create_failed( font_info, NULL, 0, face, size );
+		return NULL;
+	}
+	font_build_quads( font_info );
+	font_attach_cache( font_info, &cache_layout, face, size, filename );
+	font_info_t* shared = font_registry_add_font( font_info, filename, height, sdf, phases,
+			first_codepoint, last_codepoint );
+	if( shared != font_info )
+		font_destroy( font_info );
+	return shared;
+}
+
+// Frees what font_create_range() got so far, any argument may be NULL
+static void font_create_failed( font_info_t* font_info, font_bitmap_t* bitmaps, unsigned int count,
+		font_face_t* face, FT_Size size ) {
+	if( NULL != bitmaps )
+		font_raster_free( bitmaps, count );
+	free( bitmaps );
+	if( NULL != font_info ) {
+		free( font_info->extra_glyphs );
+		free( font_info->subpixel_glyphs );
+	}
+	free( font_info );
+	if( NULL != size ) {
+		font_face_lock( face, NULL );
+		FT_Done_Size( size );
+		font_face_unlock( face );
+	}
+	font_registry_release_face( face );
+}
+
+// qsort() comparison, descending bitmap height
+static int font_compare_height( const void* a, const void* b ) {
+	return (*(const font_bitmap_t* const*)b)->height - (*(const font_bitmap_t* const*)a)->height;
+}
+
+/* Packs rasterized bitmaps into an atlas as square as possible.
+ * Sets the atlas size and the bitmap positions in pixels */
+static bool font_pack_bitmaps( font_info_t* font_info, font_bitmap_t* bitmaps, unsigned int count ) {
+	long area = 0;
+	unsigned int num_packed = 0;
+	font_bitmap_t** order = malloc( count * sizeof( font_bitmap_t* ) );
+	if( NULL == order ) {
+		fputs( "Out of memory packing font atlas\n", stderr );
+		return false;
+	}
+	for( unsigned int i = 0; i < count; ++i ) {
+		if( 0 == bitmaps[i].code || NULL == bitmaps[i].pixels )
+			continue;
+		area += (long)( bitmaps[i].width + FONT_ATLAS_PADDING ) * (long)( bitmaps[i].height + FONT_ATLAS_PADDING );
+		order[num_packed++] = &bitmaps[i];
+	}
+	// Tallest glyphs first, that keeps the skyline flat
+	qsort( order, num_packed, sizeof( font_bitmap_t* ), font_compare_height );
+	// The atlas keeps a padding around the font
+	const int max_size = (int)font_atlas_max_layer_size() - 2 * FONT_ATLAS_PADDING;
+	// Start with the square root of the area and widen until everything fits
+	int width = (int)ceilf( sqrtf( (float)area ) ) + FONT_ATLAS_PADDING;
+	while( width <= max_size ) {
+		atlas_packer_t packer;
+		if( !atlas_packer_init( &packer, width, max_size, FONT_ATLAS_PADDING ) ) {
+			fputs( "Out of memory packing font atlas\n", stderr );
+			free( order );
+			return false;
+		}
+		bool ok = true;
+		for( unsigned int i = 0; ok && i < num_packed; ++i ) {
+			font_bitmap_t* b = order[i];
+			ok = atlas_packer_add( &packer, b->width, b->height, &b->x, &b->y );
 		}
+		if( ok ) {
+			// At least one texel so that fonts without any bitmaps still get a valid texture
+			const int used_height = atlas_packer_used_height( &packer );
+			font_info->texture_width = (unsigned int)width;
+			font_info->texture_height = (unsigned int)( used_height > 0 ? used_height : 1 );
+			font_info->packing_efficiency = atlas_packer_efficiency( &packer );
+			printf( "Font atlas %ux%u, %u glyphs, packing efficiency %.1f%%\n", font_info->texture_width,
+					font_info->texture_height, num_packed, 100.0f * font_info->packing_efficiency );
+			atlas_packer_delete( &packer );
+			free( order );
+			return true;
+		}
+		atlas_packer_delete( &packer );
+		width += width / 4 + 1;
+	}
+	fprintf( stderr, "Font atlas exceeds the maximum layer size of %d\n", max_size );
+	free( order );
+	return false;
+}
+
+/* Reserves the glyph cache page below the packed glyphs and grows the atlas size.
+ * Cells fit the largest glyph of the face, the face's pixel size must be set */
+static void font_layout_cache( font_info_t* font_info, FT_Face face, font_cache_layout_t* layout ) {
+	const int border = FONT_ATLAS_PADDING + 2 * (int)font_info->sdf_spread;
+	layout->origin_y = (int)font_info->texture_height;
+	layout->cell_width = (int)( FT_MulFix( face->bbox.xMax - face->bbox.xMin,
+			face->size->metrics.x_scale ) >> 6 ) + 1 + border;
+	layout->cell_height = (int)( FT_MulFix( face->bbox.yMax - face->bbox.yMin,
+			face->size->metrics.y_scale ) >> 6 ) + 1 + border;
+	const int max_size = (int)font_atlas_max_layer_size() - 2 * FONT_ATLAS_PADDING;
+	layout->columns = FONT_CACHE_COLUMNS;
+	if( layout->columns * layout->cell_width > max_size )
+		layout->columns = max_size / layout->cell_width;
+	layout->rows = FONT_CACHE_ROWS;
+	if( layout->origin_y + layout->rows * layout->cell_height > max_size )
+		layout->rows = ( max_size - layout->origin_y ) / layout->cell_height;
+	if( layout->columns > 0 && layout->rows > 0 ) {
+		if( font_info->texture_width < (unsigned int)( layout->columns * layout->cell_width ) )
+			font_info->texture_width = (unsigned int)( layout->columns * layout->cell_width );
+		font_info->texture_height += (unsigned int)( layout->rows * layout->cell_height );
 	}
-	font_cleanup();
-	return NULL;
 }
 
-// If font is ok cleanup() must be called by caller, else cleans up and returns false
-static bool font_init_and_check( const char* filename ) {
-	bool ok = true;
-	if( FT_Init_FreeType( &ft ) ) {
-		fputs(" Could not init FreeType Library\n", stderr );
-		ok = false;
+/* Looks up the kerning of all ASCII pairs once, FT_Get_Kerning() is too slow for every frame.
+ * The face's pixel size must be set. All 0 if the face has no kerning table */
+static void font_fill_kerning( font_info_t* font_info, FT_Face face ) {
+	if( !FT_HAS_KERNING( face ) )
+		return;
+	FT_UInt index[96];
+	for( unsigned int i = 0; i < 96; ++i )
+		index[i] = FT_Get_Char_Index( face, i + 32 );
+	for( unsigned int l = 0; l < 96; ++l )
+		for( unsigned int r = 0; r < 96; ++r ) {
+			FT_Vector delta;
+			// Subpixel positioned fonts keep the fractional part
+			if( 0 != index[l] && 0 != index[r] && !FT_Get_Kerning( face, index[l], index[r],
+					font_info->subpixel_phases > 1 ? FT_KERNING_UNFITTED : FT_KERNING_DEFAULT, &delta ) )
+				font_info->kerning[l][r] = font_info->subpixel_phases > 1 ?
+						(float)delta.x / 64.0f : (float)( delta.x >> 6 );
+		}
+}
+
+// The cache keeps face and size for rasterizing glyphs on demand, else they are released
+static void font_attach_cache( font_info_t* font_info, const font_cache_layout_t* layout,
+		font_face_t* face, FT_Size size, const char* filename ) {
+	if( layout->columns > 0 && layout->rows > 0 )
+		font_info->cache = glyph_cache_create( face, size, font_info->atlas_layer, font_info->texture_width,
+				font_info->texture_height, font_info->atlas_x, font_info->atlas_y + layout->origin_y,
+				font_info->pixels + (size_t)layout->origin_y * font_info->atlas_width, (int)font_info->atlas_width,
+				layout->cell_width, layout->cell_height,
+				layout->columns, layout->rows, (int)font_info->sdf_spread, font_info->subpixel_phases > 1 );
+	if( NULL == font_info->cache ) {
+		fprintf( stderr, "No glyph cache for font '%s', only preloaded glyphs available\n", filename );
+		font_face_lock( face, NULL );
+		FT_Done_Size( size );
+		font_face_unlock( face );
+		font_registry_release_face( face );
+	}
+}
+
+bool font_bake( const font_info_t* font, const char* filename ) {
+	// Only the packed glyphs are stored, the glyph cache page needs FreeType and stays behind
+	unsigned int width = 1;
+	unsigned int height = 1;
+	for( unsigned int i = 0; i < font_num_preloaded_glyphs( font ); ++i ) {
+		const glyph_info_t* g = font_preloaded_glyph( font, i );
+		const unsigned int right = (unsigned int)( lroundf( g->offset_x * (float)font->texture_width + g->size_x ) -
+				font->atlas_x );
+		const unsigned int bottom = (unsigned int)( lroundf( g->offset_y * (float)font->texture_height + g->size_y ) -
+				font->atlas_y );
+		if( right > width )
+			width = right;
+		if( bottom > height )
+			height = bottom;
 	}
-	if( ok && FT_New_Face( ft, filename, 0, &face ) ) {
-		fprintf( stderr, "Failed to load font face from '%s'\n", filename );
-		ok = false;
+	// Cropped from the font's CPU image
+	const size_t texture_size = (size_t)width * height;
+	unsigned char* pixels = malloc( texture_size );
+	if( NULL == pixels ) {
+		fputs( "Out of memory baking font\n", stderr );
+		return false;
 	}
-	if( ok && !face->face_flags & FT_FACE_FLAG_SCALABLE ) {
-		fprintf( stderr, "Font '%s' is not scalable\n", filename );
-		ok = false;
+	for( unsigned int y = 0; y < height; ++y )
+		memcpy( pixels + (size_t)y * width, font->pixels + (size_t)y * font->atlas_width, width );
+	font_baked_header_t header;
+	memcpy( header.magic, FONT_BAKED_MAGIC, sizeof( header.magic ) );
+	header.version = FONT_BAKED_VERSION;
+	header.glyph_size = sizeof( glyph_info_t );
+	header.num_glyphs = font_num_preloaded_glyphs( font );
+	header.height = font->height;
+	header.texture_width = width;
+	header.texture_height = height;
+	header.packing_efficiency = font->packing_efficiency;
+	header.sdf_spread = font->sdf_spread;
+	header.subpixel_phases = font->subpixel_phases;
+	header.pixel_offset = (uint32_t)( sizeof( header ) + header.num_glyphs * sizeof( glyph_info_t ) +
+			sizeof( font->kerning ) );
+	FILE* f = fopen( filename, "wb" );
+	if( NULL == f ) {
+		fprintf( stderr, "Error opening baked font file '%s' for writing\n", filename );
+		free( pixels );
+		return false;
 	}
-	if( ok && NULL == face->charmap ) {
-		fprintf( stderr, "Font '%s' seems to have no unicode charmap\n", filename );
-		ok = false;
+	bool ok = 1 == fwrite( &header, sizeof( header ), 1, f );
+	// Texture coordinates refer to the cropped rectangle of the font
+	for( unsigned int i = 0; ok && i < header.num_glyphs; ++i ) {
+		glyph_info_t g = *font_preloaded_glyph( font, i );
+		g.offset_x = roundf( g.offset_x * (float)font->texture_width - (float)font->atlas_x ) / (float)width;
+		g.offset_y = roundf( g.offset_y * (float)font->texture_height - (float)font->atlas_y ) / (float)height;
+		ok = 1 == fwrite( &g, sizeof( g ), 1, f );
 	}
+	ok = ok && 1 == fwrite( font->kerning, sizeof( font->kerning ), 1, f ) &&
+			1 == fwrite( pixels, texture_size, 1, f );
+	ok = 0 == fclose( f ) && ok;
+	free( pixels );
 	if( !ok )
-		font_cleanup();
+		fprintf( stderr, "Error writing baked font file '%s'\n", filename );
 	return ok;
 }
 
-static void font_cleanup() {
-	if( face )
-		FT_Done_Face( face );
-	if( ft )
-		FT_Done_FreeType( ft );
-	face = NULL;
-	ft = NULL;
+// False if a glyph of a baked font file lies outside of its width x height atlas, offsets in texels.
+// NaNs fail every comparison
+static bool font_baked_glyph_valid( const glyph_info_t* g, unsigned int width, unsigned int height ) {
+	return g->size_x >= 0.0f && g->size_y >= 0.0f && g->offset_x >= 0.0f && g->offset_y >= 0.0f &&
+			g->offset_x + g->size_x <= (float)width && g->offset_y + g->size_y <= (float)height;
+}
+
+font_info_t* font_create_from_baked( const char* const filename ) {
+	const int fd = open( filename, O_RDONLY );
+	if( fd < 0 ) {
+		fprintf( stderr, "Error opening baked font file '%s'\n", filename );
+		return NULL;
+	}
+	struct stat st;
+	if( 0 != fstat( fd, &st ) || (size_t)st.st_size < sizeof( font_baked_header_t ) ) {
+		fprintf( stderr, "Baked font file '%s' is too short\n", filename );
+		close( fd );
+		return NULL;
+	}
+	const size_t file_size = (size_t)st.st_size;
+	const unsigned char* data = mmap( NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	// The mapping stays valid after the descriptor is closed
+	close( fd );
+	if( MAP_FAILED == data ) {
+		fprintf( stderr, "Error mapping baked font file '%s'\n", filename );
+		return NULL;
+	}
+	const font_baked_header_t* header = (const font_baked_header_t*)data;
+	if( 0 != memcmp( header->magic, FONT_BAKED_MAGIC, sizeof( header->magic ) ) ||
+			FONT_BAKED_VERSION != header->version || sizeof( glyph_info_t ) != header->glyph_size ||
+			header->subpixel_phases < 1 || header->subpixel_phases > 64 ||
+			header->num_glyphs < 96 * header->subpixel_phases ||
+			header->pixel_offset < sizeof( font_baked_header_t ) + header->num_glyphs * sizeof( glyph_info_t ) +
+					sizeof( ( (font_info_t*)NULL )->kerning ) ||
+			(size_t)header->pixel_offset + (size_t)header->texture_width * header->texture_height > file_size ) {
+		fprintf( stderr, "'%s' is not a baked font file of version %d\n", filename, FONT_BAKED_VERSION );
+		munmap( (void*)data, file_size );
+		return NULL;
+	}
+	font_info_t* font_info = calloc( 1, sizeof( font_info_t ) );
+	const unsigned int phases = header->subpixel_phases;
+	const unsigned int num_extra = header->num_glyphs - 96 * phases;
+	if( NULL != font_info ) {
+		if( num_extra > 0 )
+			font_info->extra_glyphs = malloc( num_extra * sizeof( glyph_info_t ) );
+		if( phases > 1 )
+			font_info->subpixel_glyphs = malloc( ( phases - 1 ) * 96 * sizeof( glyph_info_t ) );
+		if( ( num_extra > 0 && NULL == font_info->extra_glyphs ) ||
+				( phases > 1 && NULL == font_info->subpixel_glyphs ) ) {
+			free( font_info->extra_glyphs );
+			free( font_info->subpixel_glyphs );
+			free( font_info );
+			font_info = NULL;
+		}
+	}
+	if( NULL != font_info ) {
+		font_info->height = header->height;
+		font_info->packing_efficiency = header->packing_efficiency;
+		font_info->sdf_spread = header->sdf_spread;
+		font_info->subpixel_phases = phases;
+		font_info->num_extra_glyphs = num_extra;
+		// Without FreeType there is nothing to rasterize other glyphs with, cache stays NULL.
+		// Texture coordinates were stored for the baked size, font_upload() wants texels
+		const glyph_info_t* glyphs = (const glyph_info_t*)( data + sizeof( font_baked_header_t ) );
+		bool valid = true;
+		for( unsigned int i = 0; i < header->num_glyphs; ++i ) {
+			glyph_info_t* g = font_preloaded_glyph( font_info, i );
+			*g = glyphs[i];
+			g->offset_x = roundf( g->offset_x * (float)header->texture_width );
+			g->offset_y = roundf( g->offset_y * (float)header->texture_height );
+			valid = valid && font_baked_glyph_valid( g, header->texture_width, header->texture_height );
+		}
+		memcpy( font_info->kerning, glyphs + header->num_glyphs, sizeof( font_info->kerning ) );
+		if( !valid ) {
+			fprintf( stderr, "Baked font file '%s' has glyphs outside of its atlas\n", filename );
+			free( font_info->extra_glyphs );
+			free( font_info->subpixel_glyphs );
+			free( font_info );
+			munmap( (void*)data, file_size );
+			return NULL;
+		}
+		printf( "Loading baked font '%s'\n", filename );
+		// The font keeps a copy, the mapping goes
+		const size_t texture_size = (size_t)header->texture_width * header->texture_height;
+		unsigned char* pixels = malloc( texture_size );
+		if( NULL != pixels )
+			memcpy( pixels, data + header->pixel_offset, texture_size );
+		if( NULL == pixels || !font_upload( font_info, pixels, header->texture_width, header->texture_height ) ) {
+			free( pixels );
+			free( font_info->extra_glyphs );
+			free( font_info->subpixel_glyphs );
+			free( font_info );
+			font_info = NULL;
+		} else
+			font_build_quads( font_info );
+	}
+	munmap( (void*)data, file_size );
+	return font_info;
+}
+
+/* Places the font's width x height pixels in the atlas and uploads them, the font takes them as
+ * its CPU image on success. The offsets of the preloaded glyphs come in texels of the pixels
+ * and are normalized to the atlas layer */
+static bool font_upload( font_info_t* font_info, unsigned char* pixels,
+		unsigned int width, unsigned int height ) {
+	if( num_atlas_fonts == atlas_fonts_capacity ) {
+		const unsigned int c = atlas_fonts_capacity > 0 ? 2 * atlas_fonts_capacity : 8;
+		font_info_t** f = realloc( atlas_fonts, c * sizeof( font_info_t* ) );
+		if( NULL == f ) {
+			fputs( "Out of memory for the font list\n", stderr );
+			return false;
+		}
+		atlas_fonts = f;
+		atlas_fonts_capacity = c;
+	}
+	const unsigned int old_size = font_atlas_layer_size();
+	if( !font_atlas_allocate( width, height, &font_info->atlas_layer, &font_info->atlas_x, &font_info->atlas_y ) )
+		return false;
+	// Texel positions survive a growth, normalized coordinates of the other fonts do not
+	if( 0 != old_size && old_size != font_atlas_layer_size() )
+		font_atlas_resized( old_size, font_atlas_layer_size() );
+	font_info->atlas_width = width;
+	font_info->atlas_height = height;
+	font_info->texture_width = font_info->texture_height = font_atlas_layer_size();
+	for( unsigned int i = 0; i < font_num_preloaded_glyphs( font_info ); ++i ) {
+		glyph_info_t* g = font_preloaded_glyph( font_info, i );
+		g->offset_x = ( g->offset_x + (float)font_info->atlas_x ) / (float)font_info->texture_width;
+		g->offset_y = ( g->offset_y + (float)font_info->atlas_y ) / (float)font_info->texture_height;
+	}
+	font_atlas_upload( font_info->atlas_layer, font_info->atlas_x, font_info->atlas_y, (int)width, (int)height, pixels );
+	font_info->pixels = pixels;
+	atlas_fonts[num_atlas_fonts++] = font_info;
+	return true;
+}
+
+// Renormalizes the texture coordinates of all fonts after the atlas layers grew
+static void font_atlas_resized( unsigned int old_size, unsigned int size ) {
+	for( unsigned int f = 0; f < num_atlas_fonts; ++f ) {
+		font_info_t* font = atlas_fonts[f];
+		for( unsigned int i = 0; i < font_num_preloaded_glyphs( font ); ++i ) {
+			glyph_info_t* g = font_preloaded_glyph( font, i );
+			g->offset_x = roundf( g->offset_x * (float)old_size ) / (float)size;
+			g->offset_y = roundf( g->offset_y * (float)old_size ) / (float)size;
+		}
+		font->texture_width = font->texture_height = size;
+		if( NULL != font->cache )
+			glyph_cache_set_texture_size( font->cache, size, size );
+	}
+}
+
+// Preloaded glyphs are sorted by codepoint
+static const glyph_info_t* font_find_extra_glyph( const font_info_t* font, unsigned int codepoint ) {
+	unsigned int low = 0;
+	unsigned int high = font->num_extra_glyphs;
+	while( low < high ) {
+		const unsigned int mid = ( low + high ) / 2;
+		if( font->extra_glyphs[mid].code < codepoint )
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if( low < font->num_extra_glyphs && font->extra_glyphs[low].code == codepoint )
+		return &font->extra_glyphs[low];
+	return NULL;
+}
+
+const glyph_info_t* font_get_glyph( const font_info_t* font, unsigned int codepoint, bool pin ) {
+	if( codepoint >= 32 && codepoint < 128 )
+		return &font->glyphs[codepoint - 32];
+	const glyph_info_t* g = font_find_extra_glyph( font, codepoint );
+	if( NULL != g )
+		return g;
+	if( NULL == font->cache || codepoint < 32 )
+		return NULL;
+	return glyph_cache_get( font->cache, codepoint, pin );
+}
+
+bool font_pin_glyph( const font_info_t* font, unsigned int codepoint ) {
+	// Only glyphs outside of the prebuilt atlas are cached
+	if( NULL == font->cache || codepoint < 128 || NULL != font_find_extra_glyph( font, codepoint ) )
+		return true;
+	return glyph_cache_pin( font->cache, codepoint );
+}
+
+void font_unpin_glyph( const font_info_t* font, unsigned int codepoint ) {
+	// Preloaded glyphs are not cached, unpinning them finds nothing
+	if( NULL != font->cache && codepoint >= 128 )
+		glyph_cache_unpin( font->cache, codepoint );
+}
+
+unsigned int font_utf8_next( const char** text ) {
+	const unsigned char* p = (const unsigned char*)*text;
+	if( 0 == p[0] )
+		return 0;
+	unsigned int cp;
+	int n;
+	if( p[0] < 0x80 ) {
+		cp = p[0];
+		n = 0;
+	} else if( ( p[0] & 0xe0 ) == 0xc0 ) {
+		cp = p[0] & 0x1fu;
+		n = 1;
+	} else if( ( p[0] & 0xf0 ) == 0xe0 ) {
+		cp = p[0] & 0x0fu;
+		n = 2;
+	} else if( ( p[0] & 0xf8 ) == 0xf0 ) {
+		cp = p[0] & 0x07u;
+		n = 3;
+	} else {
+		*text += 1;
+		return 0xfffd;
+	}
+	for( int i = 1; i <= n; ++i ) {
+		// Also stops at the terminating 0
+		if( ( p[i] & 0xc0 ) != 0x80 ) {
+			*text += i;
+			return 0xfffd;
+		}
+		cp = ( cp << 6 ) | ( p[i] & 0x3fu );
+	}
+	*text += n + 1;
+	return cp;
+}
+
+void font_cache_stats( const font_info_t* font, font_cache_stats_t* out_stats ) {
+	if( NULL != font->cache )
+		*out_stats = font->cache->stats;
+	else
+		memset( out_stats, 0, sizeof( font_cache_stats_t ) );
 }
 
 void font_delete( font_info_t* font_info ) {
-	if( glIsTexture( font_info->texture_atlas ) )
-		glDeleteTextures( 1, &font_info->texture_atlas );
-	if( NULL != font_info )
-		free( font_info );
+	if( NULL != font_info && font_registry_release_font( font_info ) )
+		font_destroy( font_info );
+}
+
+static void font_destroy( font_info_t* font_info ) {
+	for( unsigned int f = 0; f < num_atlas_fonts; ++f )
+		if( atlas_fonts[f] == font_info ) {
+			atlas_fonts[f] = atlas_fonts[--num_atlas_fonts];
+			break;
+		}
+	if( 0 == num_atlas_fonts ) {
+		free( atlas_fonts );
+		atlas_fonts = NULL;
+		atlas_fonts_capacity = 0;
+	}
+	font_atlas_release( font_info->atlas_layer );
+	glyph_cache_delete( font_info->cache );
+	free( font_info->pixels );
+	free( font_info->extra_glyphs );
+	free( font_info->subpixel_glyphs );
+	free( font_info->quads );
+	free( font_info );
+}
+
+// Precomputes the quads of glyphs 32-127 once the atlas layer is known. Without them layout
+// takes the glyph_info_t path, so failing here is not fatal
+static void font_build_quads( font_info_t* font_info ) {
+	const unsigned int n = 96 * font_info->subpixel_phases;
+	for( unsigned int i = 0; i < n; ++i )
+		if( 0.0f != font_preloaded_glyph( font_info, i )->ay )
+			return;
+	font_info->quads = aligned_alloc( _Alignof( glyph_quad_t ), n * sizeof( glyph_quad_t ) );
+	if( NULL == font_info->quads )
+		return;
+	for( unsigned int i = 0; i < n; ++i ) {
+		const glyph_info_t* g = font_preloaded_glyph( font_info, i );
+		glyph_quad_t* q = &font_info->quads[i];
+		memset( q, 0, sizeof( glyph_quad_t ) );
+		q->ax = g->ax;
+		q->layer = (unsigned int)font_info->atlas_layer;
+		if( 0 == g->size_x || 0 == g->size_y )
+			continue;
+		q->rect[0] = g->bearing_x;
+		q->rect[1] = g->bearing_y - g->size_y;
+		q->rect[2] = g->size_x;
+		q->rect[3] = g->size_y;
+		// Offsets are normalized to the layer size, a power of two, so texels are exact
+		q->texel_rect[0] = (unsigned short)( g->offset_x * (float)font_info->texture_width + 0.5f );
+		q->texel_rect[1] = (unsigned short)( g->offset_y * (float)font_info->texture_height + 0.5f );
+		q->texel_rect[2] = (unsigned short)g->size_x;
+		q->texel_rect[3] = (unsigned short)g->size_y;
+	}
+}
+
+// Glyphs of the atlas in baked file order: 32-127, subpixel variants, other preloaded glyphs
+static unsigned int font_num_preloaded_glyphs( const font_info_t* font_info ) {
+	return 96 * font_info->subpixel_phases + font_info->num_extra_glyphs;
+}
+
+static glyph_info_t* font_preloaded_glyph( const font_info_t* font_info, unsigned int index ) {
+	const unsigned int num_subpixel = 96 * ( font_info->subpixel_phases - 1 );
+	if( index < 96 )
+		return (glyph_info_t*)&font_info->glyphs[index];
+	index -= 96;
+	return index < num_subpixel ? &font_info->subpixel_glyphs[index] : &font_info->extra_glyphs[index - num_subpixel];
 }
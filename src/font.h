@@ -1,6 +1,6 @@
 
 /*
- * Build a font atlas, all glyphs sequentially in a row
+ * Build a font atlas, glyphs are skyline packed into a near square texture
  * https://gitlab.com/wikibooks-opengl/modern-tutorials/-/blob/master/text02_atlas/text.cpp
  */
 
@@ -9,8 +9,19 @@
 #include <stdbool.h>
 #include "glad/glad.h"
 
+// Empty texels between glyphs in the atlas, avoids bleeding with linear filtering
+#define FONT_ATLAS_PADDING 1
+
+// Glyph cache page below the packed ASCII glyphs, in cells of the maximum glyph size
+#define FONT_CACHE_COLUMNS 16
+#define FONT_CACHE_ROWS 8
+// Distance range in atlas pixels on each side of the outline for distance field fonts
+#define FONT_SDF_SPREAD 6
+// Horizontal subpixel positions per pixel of font_create_subpixel(), at most 64
+#define FONT_SUBPIXEL_PHASES 4
+
 typedef struct {
-	char code;
+	unsigned int code;	// unicode codepoint
 	float ax;			// advance x
 	float ay;			// advance y
 	float size_x;		// bitmap width;
@@ -18,19 +29,122 @@ typedef struct {
 	float bearing_x;	// bitmap bearing top left;
 	float bearing_y;
 	float offset_x;		// x offset of glyph in texture coordinates
-	float offset_y;		// y offset of glyph in texture coordinates (multiline, not implemented)
+	float offset_y;		// y offset of glyph in texture coordinates
 } glyph_info_t;
 
+// Quad of a glyph 32-127 relative to the pen at scale 1, precomputed when the font is created.
+// 32 bytes, 16 byte aligned, so layout translates rect with one vector multiply-add
 typedef struct {
-	GLuint texture_atlas;
+	// Lower left corner relative to the pen, width and height in pixels
+	_Alignas( 16 ) float rect[4];
+	// Left, top, width and height of the bitmap in the atlas layer, in texels
+	unsigned short texel_rect[4];
+	unsigned int layer;
+	float ax;
+} glyph_quad_t;
+
+typedef struct {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+	// Cells in use
+	unsigned long glyphs;
+} font_cache_stats_t;
+
+typedef struct glyph_cache_s glyph_cache_t;
+
+typedef struct {
+	// Layer of the shared texture array, see font_atlas.h
+	int atlas_layer;
+	// Upper left and size of the font's rectangle in the layer, in texels
+	int atlas_x;
+	int atlas_y;
+	unsigned int atlas_width;
+	unsigned int atlas_height;
+	// CPU copy of the font's rectangle, atlas_width x atlas_height R8 rows from the top.
+	// The glyph cache writes into it too, the software renderer samples it
+	unsigned char* pixels;
 	unsigned int height;
+	// Size of the atlas layer, texture coordinates are normalized to it. Updated when the layers grow
 	unsigned int texture_width;
 	unsigned int texture_height;
+	// Packed glyph area / used atlas area, [0-1]
+	float packing_efficiency;
+	// 0 for a coverage atlas, else the atlas holds signed distance fields, see font_create_sdf()
+	unsigned int sdf_spread;
 	glyph_info_t glyphs[96];	// starts at 32
+	// 1, or the number of horizontal subpixel positions of glyphs 32-127, see font_create_subpixel()
+	unsigned int subpixel_phases;
+	// ( subpixel_phases - 1 ) * 96 glyphs shifted right by 1 / subpixel_phases pixels each,
+	// phase 0 is glyphs[]
+	glyph_info_t* subpixel_glyphs;
+	// Horizontal pair kerning in pixels at height, [left - 32][right - 32]. Only ASCII pairs
+	// are kerned, so layout costs one lookup per glyph
+	float kerning[96][96];
+	// Glyphs outside of 32-127 preloaded by font_create_range(), sorted by codepoint
+	glyph_info_t* extra_glyphs;
+	unsigned int num_extra_glyphs;
+	// Quads of glyphs 32-127 in all subpixel phases, [phase * 96 + codepoint - 32].
+	// Glyphs without bitmap have an empty rect. NULL if any of them advances vertically
+	glyph_quad_t* quads;
+	// Other codepoints, rasterized on first use. NULL if not available
+	glyph_cache_t* cache;
 } font_info_t;
 
 font_info_t* font_create( const char* const filename, unsigned int height );
 
+/* Creates a font whose atlas holds signed distance fields rasterized at height.
+ * It renders sharp at any text height with the distance field shader, so one
+ * atlas serves all sizes. Pick height around the largest size used, 32-48 does well */
+font_info_t* font_create_sdf( const char* const filename, unsigned int height );
+
+/* Creates a font with FONT_SUBPIXEL_PHASES variants of glyphs 32-127, each shifted by a fraction
+ * of a pixel. Layout picks the variant nearest to the fractional pen position, so text at
+ * fractional positions stays sharp and does not shimmer when it moves. Glyphs are not hinted
+ * horizontally and advance by fractional amounts */
+font_info_t* font_create_subpixel( const char* const filename, unsigned int height );
+
+/* Like font_create(), but rasterizes the codepoints first-last up front in addition to 32-127,
+ * on num_threads worker threads with a FreeType face each. The main thread packs the
+ * bitmaps and uploads the atlas at once. Codepoints the face has no glyph for are left out.
+ * With sdf the atlas holds distance fields, see font_create_sdf(). subpixel_phases > 1
+ * adds subpixel variants, see font_create_subpixel(), distance field fonts ignore it.
+ * Fonts are shared, a request identical to an earlier one returns that font */
+font_info_t* font_create_range( const char* const filename, unsigned int height, bool sdf,
+		unsigned int subpixel_phases, unsigned int first_codepoint, unsigned int last_codepoint, unsigned int num_threads );
+
+/* Writes atlas pixels and glyph metrics of a font to a baked font file.
+ * The glyph cache page is not stored */
+bool font_bake( const font_info_t* font, const char* filename );
+
+/* Creates a font from a baked font file, see font_bake(). The file is memory mapped, the atlas
+ * pixels are copied out of the mapping as the font's CPU image and uploaded from that copy.
+ * FreeType is not used. Such a font has no glyph cache,
+ * only codepoints 32-127 and the preloaded ones are available */
+font_info_t* font_create_from_baked( const char* const filename );
+
+/* Returns the glyph for a unicode codepoint, in subpixel phase 0. 32-127 and preloaded codepoints come from the
+ * prebuilt atlas, others are rasterized into the glyph cache on first use.
+ * Pin glyphs whose vertices are not regenerated every frame, pinned glyphs are not evicted until unpinned.
+ * Returns NULL if there is no glyph for the codepoint or every cell of the cache is pinned, no pin is taken then */
+const glyph_info_t* font_get_glyph( const font_info_t* font, unsigned int codepoint, bool pin );
+
+/* Takes a pin like font_get_glyph() and tells whether the caller may unpin the codepoint later.
+ * False if the glyph cache could not pin the glyph for now, nothing must be unpinned for it then.
+ * True for glyphs that need no pin or can never be cached */
+bool font_pin_glyph( const font_info_t* font, unsigned int codepoint );
+
+/* Drops a pin font_get_glyph() or font_pin_glyph() took, once all are dropped the glyph may be evicted again */
+void font_unpin_glyph( const font_info_t* font, unsigned int codepoint );
+
+/* Decodes the utf-8 sequence at *text and advances *text past it.
+ * Returns 0 at the end of the string, invalid sequences decode to U+FFFD */
+unsigned int font_utf8_next( const char** text );
+
+/* Hit, miss and eviction counters of the glyph cache */
+void font_cache_stats( const font_info_t* font, font_cache_stats_t* out_stats );
+
 void font_render_texture_atlas( const font_info_t* font_info );
 
+/* Drops a reference to a shared font, the last one frees it */
 void font_delete( font_info_t* font_info );
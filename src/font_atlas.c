@@ -0,0 +1,173 @@
+#include "font_atlas.h"
+#include "font.h"
+#include "atlas_packer.h"
+#include "gl_state.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+	atlas_packer_t packer;
+	// Rectangles in use, the layer is cleared when the last one is released
+	int areas;
+} font_atlas_layer_t;
+
+static GLuint texture = 0;
+static unsigned int min_size = FONT_ATLAS_MIN_LAYER_SIZE;
+static unsigned int layer_size = 0;
+static int num_layers = 0;
+static font_atlas_layer_t* layers = NULL;
+// Limits GL 4.5 guarantees, used without a context
+#define FONT_ATLAS_SOFT_MAX_LAYER_SIZE 16384
+#define FONT_ATLAS_SOFT_MAX_LAYERS 2048
+
+static bool font_atlas_resize( unsigned int size, int n );
+
+bool font_atlas_init( unsigned int size ) {
+	if( num_layers > 0 || 0 == size || size > font_atlas_max_layer_size() ) {
+		fprintf( stderr, "Font atlas layer size %u is not possible now, fonts in use or exceeds %u\n",
+				size, font_atlas_max_layer_size() );
+		return false;
+	}
+	min_size = size;
+	return true;
+}
+
+bool font_atlas_allocate( unsigned int width, unsigned int height, int* out_layer, int* out_x, int* out_y ) {
+	// The packer keeps a padding on all sides of every rectangle
+	const unsigned int needed = ( width > height ? width : height ) + 2 * FONT_ATLAS_PADDING;
+	const unsigned int max_size = font_atlas_max_layer_size();
+	if( needed > max_size ) {
+		fprintf( stderr, "Font atlas area %ux%u exceeds the maximum layer size of %u\n", width, height, max_size );
+		return false;
+	}
+	for( ;; ) {
+		for( int i = 0; i < num_layers; ++i )
+			if( atlas_packer_add( &layers[i].packer, (int)width, (int)height, out_x, out_y ) ) {
+				++layers[i].areas;
+				*out_layer = i;
+				return true;
+			}
+		// No room, a larger font grows all layers, else one more layer of the same size
+		unsigned int size = num_layers > 0 ? layer_size : min_size;
+		while( size < needed )
+			size *= 2;
+		if( size > max_size )
+			size = max_size;
+		if( !font_atlas_resize( size, size > layer_size && num_layers > 0 ? num_layers : num_layers + 1 ) )
+			return false;
+	}
+}
+
+void font_atlas_release( int layer ) {
+	if( layer < 0 || layer >= num_layers || 0 == layers[layer].areas )
+		return;
+	if( --layers[layer].areas > 0 )
+		return;
+	int used = 0;
+	for( int i = 0; i < num_layers; ++i )
+		used += layers[i].areas;
+	// The last font takes the texture with it
+	if( 0 == used ) {
+		for( int i = 0; i < num_layers; ++i )
+			atlas_packer_delete( &layers[i].packer );
+		free( layers );
+		layers = NULL;
+		num_layers = 0;
+		layer_size = 0;
+		if( 0 != texture ) {
+			gl_state_forget_texture( texture );
+			glDeleteTextures( 1, &texture );
+			texture = 0;
+		}
+		return;
+	}
+	// Empty layers are packed from scratch, the space of single fonts is not reused
+	atlas_packer_t* p = &layers[layer].packer;
+	atlas_packer_delete( p );
+	if( !atlas_packer_init( p, (int)layer_size, (int)layer_size, FONT_ATLAS_PADDING ) )
+		fprintf( stderr, "Out of memory, font atlas layer %d stays unused\n", layer );
+	font_atlas_clear( layer, 0, 0, (int)layer_size, (int)layer_size );
+}
+
+void font_atlas_upload( int layer, int x, int y, int width, int height, const unsigned char* pixels ) {
+	if( 0 == texture )
+		return;
+	GLint upa;
+	glGetIntegerv( GL_UNPACK_ALIGNMENT, &upa );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	glTextureSubImage3D( texture, 0, x, y, layer, width, height, 1, GL_RED, GL_UNSIGNED_BYTE, pixels );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, upa );
+}
+
+void font_atlas_clear( int layer, int x, int y, int width, int height ) {
+	if( 0 == texture )
+		return;
+	const GLubyte zero = 0;
+	glClearTexSubImage( texture, 0, x, y, layer, width, height, 1, GL_RED, GL_UNSIGNED_BYTE, &zero );
+}
+
+GLuint font_atlas_texture() {
+	return texture;
+}
+
+unsigned int font_atlas_layer_size() {
+	return layer_size;
+}
+
+unsigned int font_atlas_max_layer_size() {
+	if( !gl_state_available() )
+		return FONT_ATLAS_SOFT_MAX_LAYER_SIZE;
+	GLint max_size;
+	glGetIntegerv( GL_MAX_TEXTURE_SIZE, &max_size );
+	return (unsigned int)max_size;
+}
+
+// Reallocates the array with n layers of size x size texels and copies the layers to the upper left
+static bool font_atlas_resize( unsigned int size, int n ) {
+	GLint max_layers = FONT_ATLAS_SOFT_MAX_LAYERS;
+	if( gl_state_available() )
+		glGetIntegerv( GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers );
+	font_atlas_layer_t* l = n <= max_layers ? realloc( layers, (size_t)n * sizeof( font_atlas_layer_t ) ) : NULL;
+	if( NULL == l ) {
+		fprintf( stderr, "Font atlas can not grow to %d layers\n", n );
+		return false;
+	}
+	layers = l;
+	for( int i = num_layers; i < n; ++i ) {
+		layers[i].areas = 0;
+		if( !atlas_packer_init( &layers[i].packer, (int)size, (int)size, FONT_ATLAS_PADDING ) ) {
+			while( --i >= num_layers )
+				atlas_packer_delete( &layers[i].packer );
+			fputs( "Out of memory for font atlas layers\n", stderr );
+			return false;
+		}
+	}
+	// A packer that can not grow keeps packing its old area, that is still inside the layer
+	for( int i = 0; i < num_layers; ++i )
+		atlas_packer_grow( &layers[i].packer, (int)size, (int)size );
+	const unsigned int old_size = layer_size;
+	const int old_layers = num_layers;
+	layer_size = size;
+	num_layers = n;
+	// The fonts' CPU images are all the software renderer needs
+	if( !gl_state_available() )
+		return true;
+	GLuint t;
+	glCreateTextures( GL_TEXTURE_2D_ARRAY, 1, &t );
+	glTextureParameteri( t, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTextureParameteri( t, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glTextureParameteri( t, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+	glTextureParameteri( t, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTextureStorage3D( t, 1, GL_R8, (GLsizei)size, (GLsizei)size, n );
+	// Padding between fonts and the cache cells rely on unused texels being 0
+	const GLubyte zero = 0;
+	glClearTexImage( t, 0, GL_RED, GL_UNSIGNED_BYTE, &zero );
+	if( 0 != texture ) {
+		glCopyImageSubData( texture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, t, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+				(GLsizei)old_size, (GLsizei)old_size, old_layers );
+		gl_state_forget_texture( texture );
+		glDeleteTextures( 1, &texture );
+	}
+	texture = t;
+	return true;
+}
@@ -0,0 +1,44 @@
+/*
+ * Atlas manager. All fonts live in layers of one GL_TEXTURE_2D_ARRAY, so text in different
+ * fonts and sizes samples the same texture and can be drawn with one binding.
+ * Each font takes a rectangle of a layer, skyline packed next to the other fonts. Layers are
+ * square and start at the smallest power of two that holds the first font, at least
+ * FONT_ATLAS_MIN_LAYER_SIZE. When no layer has room a layer is added, a font larger than a layer
+ * doubles the layer size up to GL_MAX_TEXTURE_SIZE. Both reallocate the array and copy the
+ * layers to the upper left, texel positions stay valid but the texture name and the layer size
+ * change, so always bind font_atlas_texture() and normalize with font_atlas_layer_size().
+ * Rectangles are not reused one by one, a layer is cleared once all fonts in it are released.
+ * Without GL, see gl_state_set_available(), only the rectangles are placed and there is no texture.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "glad/glad.h"
+
+#define FONT_ATLAS_MIN_LAYER_SIZE 256
+
+/* Sets the smallest layer size in pixels. Only possible while no font is in the atlas */
+bool font_atlas_init( unsigned int min_layer_size );
+
+/* Places a cleared width x height rectangle for a font in a layer, adds a layer or grows
+ * the layer size as needed. Returns false if it can not be placed */
+bool font_atlas_allocate( unsigned int width, unsigned int height, int* out_layer, int* out_x, int* out_y );
+
+/* Releases a rectangle of the layer */
+void font_atlas_release( int layer );
+
+/* Uploads width x height R8 pixels, rows are tightly packed */
+void font_atlas_upload( int layer, int x, int y, int width, int height, const unsigned char* pixels );
+
+/* Sets width x height texels to 0 */
+void font_atlas_clear( int layer, int x, int y, int width, int height );
+
+/* Texture array of all fonts, 0 if no font is in the atlas or without GL */
+GLuint font_atlas_texture();
+
+/* Current layer size, 0 if no font is in the atlas */
+unsigned int font_atlas_layer_size();
+
+/* Largest layer size possible */
+unsigned int font_atlas_max_layer_size();
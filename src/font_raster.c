@@ -0,0 +1,146 @@
+
+#include "font_raster.h"
+#include "sdf.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	// Face to use, NULL opens a face of its own
+	FT_Face face;
+	const unsigned char* data;
+	size_t data_size;
+	unsigned int height;
+	unsigned int sdf_spread;
+	unsigned int subpixel_phases;
+	unsigned int first;
+	unsigned int last;
+	// Worker renders first + index, first + index + stride, ...
+	unsigned int index;
+	unsigned int stride;
+	font_bitmap_t* bitmaps;
+	bool ok;
+} font_raster_job_t;
+
+static void* font_raster_worker( void* arg );
+static bool font_raster_glyph( FT_Face face, unsigned int codepoint, unsigned int sdf_spread,
+		unsigned int phase, unsigned int subpixel_phases, font_bitmap_t* b );
+
+bool font_raster_range( FT_Face face, const unsigned char* data, size_t data_size, unsigned int height,
+		unsigned int sdf_spread, unsigned int subpixel_phases, unsigned int first, unsigned int last,
+		unsigned int num_threads, font_bitmap_t* bitmaps ) {
+	const unsigned int count = last - first + 1;
+	if( num_threads < 1 )
+		num_threads = 1;
+	if( num_threads > count )
+		num_threads = count;
+	font_raster_job_t* jobs = malloc( num_threads * sizeof( font_raster_job_t ) );
+	pthread_t* threads = malloc( num_threads * sizeof( pthread_t ) );
+	if( NULL == jobs || NULL == threads ) {
+		fputs( "Out of memory starting glyph rasterization\n", stderr );
+		free( jobs );
+		free( threads );
+		return false;
+	}
+	for( unsigned int i = 0; i < num_threads; ++i ) {
+		const font_raster_job_t job = {
+				0 == i ? face : NULL, data, data_size, height, sdf_spread, subpixel_phases > 1 ? subpixel_phases : 1,
+				first, last, i, num_threads, bitmaps, false };
+		jobs[i] = job;
+	}
+	// Job 0 runs on the calling thread
+	unsigned int started = 1;
+	for( ; started < num_threads; ++started )
+		if( 0 != pthread_create( &threads[started], NULL, font_raster_worker, &jobs[started] ) ) {
+			fputs( "Could not start glyph rasterization thread\n", stderr );
+			break;
+		}
+	font_raster_worker( &jobs[0] );
+	bool ok = jobs[0].ok;
+	for( unsigned int i = 1; i < started; ++i ) {
+		pthread_join( threads[i], NULL );
+		ok = ok && jobs[i].ok;
+	}
+	// Ranges of threads that did not start are missing
+	ok = ok && started == num_threads;
+	free( jobs );
+	free( threads );
+	return ok;
+}
+
+void font_raster_free( font_bitmap_t* bitmaps, unsigned int count ) {
+	for( unsigned int i = 0; i < count; ++i ) {
+		free( bitmaps[i].pixels );
+		bitmaps[i].pixels = NULL;
+	}
+}
+
+static void* font_raster_worker( void* arg ) {
+	font_raster_job_t* job = arg;
+	FT_Library ft = NULL;
+	FT_Face face = job->face;
+	if( NULL == face ) {
+		if( FT_Init_FreeType( &ft ) ) {
+			fputs( "Could not init FreeType Library\n", stderr );
+			return NULL;
+		}
+		if( FT_New_Memory_Face( ft, job->data, (FT_Long)job->data_size, 0, &face ) ||
+				FT_Set_Pixel_Sizes( face, 0, job->height ) ) {
+			fputs( "Failed to load font face for a rasterization thread\n", stderr );
+			FT_Done_FreeType( ft );
+			return NULL;
+		}
+	}
+	job->ok = true;
+	const unsigned int count = job->last - job->first + 1;
+	for( unsigned int c = job->first + job->index; job->ok && c <= job->last; c += job->stride ) {
+		// Only ASCII is rendered as the replacement glyph if it is missing, and in all phases
+		if( c >= 32 && ( c < 128 || 0 != FT_Get_Char_Index( face, c ) ) )
+			for( unsigned int p = 0; job->ok && p < ( c < 128 ? job->subpixel_phases : 1 ); ++p )
+				job->ok = font_raster_glyph( face, c, job->sdf_spread, p, job->subpixel_phases,
+						&job->bitmaps[p * count + c - job->first] );
+	}
+	FT_Set_Transform( face, NULL, NULL );
+	if( NULL != ft ) {
+		FT_Done_Face( face );
+		FT_Done_FreeType( ft );
+	}
+	return NULL;
+}
+
+/* Renders one glyph into b, copies the bitmap without row padding. False only if out of memory.
+ * Subpixel glyphs are shifted by phase / subpixel_phases pixels */
+static bool font_raster_glyph( FT_Face face, unsigned int codepoint, unsigned int sdf_spread,
+		unsigned int phase, unsigned int subpixel_phases, font_bitmap_t* b ) {
+	FT_Int32 flags = FT_LOAD_RENDER;
+	if( subpixel_phases > 1 ) {
+		FT_Vector shift = { (FT_Pos)( phase * 64 / subpixel_phases ), 0 };
+		FT_Set_Transform( face, NULL, &shift );
+		flags |= FT_LOAD_TARGET_LIGHT;
+	}
+	if( FT_Load_Char( face, codepoint, flags ) ) {
+		fprintf( stderr, "Failed to load glyph U+%04X\n", codepoint );
+		return true;
+	}
+	const FT_GlyphSlot g = face->glyph;
+	b->code = codepoint;
+	// Subpixel positioned text needs the unhinted advance, 16.16 fixed point
+	b->ax = subpixel_phases > 1 ? (float)g->linearHoriAdvance / 65536.0f : (float)(g->advance.x >> 6);
+	b->ay = (float)(g->advance.y >> 6);
+	b->left = g->bitmap_left - (int)sdf_spread;
+	b->top = g->bitmap_top + (int)sdf_spread;
+	if( 0 == g->bitmap.width || 0 == g->bitmap.rows )
+		return true;
+	b->width = (int)( g->bitmap.width + 2 * sdf_spread );
+	b->height = (int)( g->bitmap.rows + 2 * sdf_spread );
+	b->pixels = malloc( (size_t)( b->width * b->height ) );
+	if( NULL == b->pixels )
+		return false;
+	if( sdf_spread > 0 )
+		return sdf_generate( g->bitmap.buffer, (int)g->bitmap.width, (int)g->bitmap.rows,
+				g->bitmap.pitch, (int)sdf_spread, b->pixels );
+	for( int y = 0; y < b->height; ++y )
+		memcpy( b->pixels + y * b->width, g->bitmap.buffer + y * g->bitmap.pitch, (size_t)b->width );
+	return true;
+}
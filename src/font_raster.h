@@ -0,0 +1,43 @@
+/*
+ * Renders ranges of glyphs into CPU bitmaps, optionally on worker threads.
+ * Each worker has its own FreeType library and a face on the font file's memory,
+ * FreeType objects must not be shared between threads.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+typedef struct {
+	// 0 if the face has no glyph for the codepoint
+	unsigned int code;
+	// Bitmap size and bearing, distance field border included
+	int width;
+	int height;
+	int left;
+	int top;
+	float ax;
+	float ay;
+	// Position in the atlas, set by the packer
+	int x;
+	int y;
+	// width * height bytes without row padding, NULL for empty glyphs
+	unsigned char* pixels;
+} font_bitmap_t;
+
+/* Rasterizes codepoints first-last of font file data at height pixels into bitmaps,
+ * which must hold ( last - first + 1 ) * subpixel_phases zeroed entries. Codepoints 32-127 are
+ * always rasterized, others are left out if the face has no glyph for them. Glyphs become
+ * distance fields if sdf_spread > 0. With subpixel_phases > 1 glyphs are rendered without
+ * horizontal hinting and with fractional advances, and 32-127 additionally shifted right by
+ * phase / subpixel_phases pixels into entry phase * ( last - first + 1 ) + codepoint - first.
+ * The range is split among num_threads workers, 0 or 1 renders on the calling thread.
+ * face, if not NULL, is used for the calling thread's share and must have the pixel size set */
+bool font_raster_range( FT_Face face, const unsigned char* data, size_t data_size, unsigned int height,
+		unsigned int sdf_spread, unsigned int subpixel_phases, unsigned int first, unsigned int last, unsigned int num_threads, font_bitmap_t* bitmaps );
+
+/* Frees the pixels of count bitmaps, not the array itself */
+void font_raster_free( font_bitmap_t* bitmaps, unsigned int count );
@@ -0,0 +1,248 @@
+#define _XOPEN_SOURCE 700	// realpath(), strdup() and PATH_MAX also with -std=c11
+
+#include "font_registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>		// PATH_MAX
+#include <fcntl.h>		// open()
+#include <unistd.h>		// close()
+#include <sys/mman.h>	// mmap()
+#include <sys/stat.h>
+
+typedef struct font_entry_s {
+	font_info_t* font;
+	char* filename;
+	unsigned int height;
+	bool sdf;
+	unsigned int subpixel_phases;
+	unsigned int first_codepoint;
+	unsigned int last_codepoint;
+	unsigned int refcount;
+	struct font_entry_s* next;
+} font_entry_t;
+
+// Guards the library, the lists and all reference counts
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static FT_Library ft = NULL;
+static font_face_t* faces = NULL;
+static font_entry_t* fonts = NULL;
+
+static bool font_registry_open_face( font_face_t* f );
+static void font_registry_canonical( const char* filename, char* out );
+static font_entry_t* font_registry_find_entry( const char* path, unsigned int height, bool sdf,
+		unsigned int subpixel_phases, unsigned int first_codepoint, unsigned int last_codepoint );
+
+font_face_t* font_registry_acquire_face( const char* filename ) {
+	char path[PATH_MAX];
+	font_registry_canonical( filename, path );
+	pthread_mutex_lock( &registry_lock );
+	font_face_t* f = faces;
+	while( NULL != f && 0 != strcmp( f->filename, path ) )
+		f = f->next;
+	if( NULL != f ) {
+		++f->refcount;
+		pthread_mutex_unlock( &registry_lock );
+		return f;
+	}
+	if( NULL == ft && FT_Init_FreeType( &ft ) ) {
+		fputs( "Could not init FreeType Library\n", stderr );
+		ft = NULL;
+		pthread_mutex_unlock( &registry_lock );
+		return NULL;
+	}
+	f = calloc( 1, sizeof( font_face_t ) );
+	if( NULL != f ) {
+		f->filename = strdup( path );
+		if( NULL == f->filename || !font_registry_open_face( f ) ) {
+			free( f->filename );
+			free( f );
+			f = NULL;
+		}
+	}
+	if( NULL != f ) {
+		pthread_mutex_init( &f->lock, NULL );
+		f->refcount = 1;
+		f->next = faces;
+		faces = f;
+	}
+	// The library goes with the last face
+	if( NULL == faces ) {
+		FT_Done_FreeType( ft );
+		ft = NULL;
+	}
+	pthread_mutex_unlock( &registry_lock );
+	return f;
+}
+
+void font_registry_release_face( font_face_t* f ) {
+	if( NULL == f )
+		return;
+	pthread_mutex_lock( &registry_lock );
+	if( 0 == --f->refcount ) {
+		font_face_t** link = &faces;
+		while( *link != f )
+			link = &(*link)->next;
+		*link = f->next;
+		FT_Done_Face( f->face );
+		munmap( (void*)f->data, f->data_size );
+		pthread_mutex_destroy( &f->lock );
+		free( f->filename );
+		free( f );
+		if( NULL == faces ) {
+			FT_Done_FreeType( ft );
+			ft = NULL;
+		}
+	}
+	pthread_mutex_unlock( &registry_lock );
+}
+
+FT_Size font_face_new_size( font_face_t* f, unsigned int height ) {
+	FT_Size size;
+	// New sizes and faces change the library's lists
+	pthread_mutex_lock( &registry_lock );
+	const bool failed = FT_New_Size( f->face, &size ) || FT_Activate_Size( size ) ||
+			FT_Set_Pixel_Sizes( f->face, 0, height );
+	pthread_mutex_unlock( &registry_lock );
+	if( failed ) {
+		fprintf( stderr, "Failed to set size %u of font '%s'\n", height, f->filename );
+		return NULL;
+	}
+	return size;
+}
+
+void font_face_lock( font_face_t* f, FT_Size size ) {
+	pthread_mutex_lock( &f->lock );
+	if( NULL != size )
+		FT_Activate_Size( size );
+}
+
+void font_face_unlock( font_face_t* f ) {
+	pthread_mutex_unlock( &f->lock );
+}
+
+font_info_t* font_registry_find_font( const char* filename, unsigned int height, bool sdf,
+		unsigned int subpixel_phases, unsigned int first_codepoint, unsigned int last_codepoint ) {
+	char path[PATH_MAX];
+	font_registry_canonical( filename, path );
+	pthread_mutex_lock( &registry_lock );
+	font_entry_t* e = font_registry_find_entry( path, height, sdf, subpixel_phases, first_codepoint, last_codepoint );
+	if( NULL != e )
+		++e->refcount;
+	pthread_mutex_unlock( &registry_lock );
+	return NULL != e ? e->font : NULL;
+}
+
+font_info_t* font_registry_add_font( font_info_t* font, const char* filename, unsigned int height, bool sdf,
+		unsigned int subpixel_phases, unsigned int first_codepoint, unsigned int last_codepoint ) {
+	char path[PATH_MAX];
+	font_registry_canonical( filename, path );
+	font_entry_t* e = malloc( sizeof( font_entry_t ) );
+	if( NULL != e )
+		e->filename = strdup( path );
+	if( NULL == e || NULL == e->filename ) {
+		// Works on, just without sharing
+		free( e );
+		return font;
+	}
+	e->font = font;
+	e->height = height;
+	e->sdf = sdf;
+	e->subpixel_phases = subpixel_phases;
+	e->first_codepoint = first_codepoint;
+	e->last_codepoint = last_codepoint;
+	e->refcount = 1;
+	pthread_mutex_lock( &registry_lock );
+	font_entry_t* existing = font_registry_find_entry( path, height, sdf, subpixel_phases, first_codepoint, last_codepoint );
+	if( NULL != existing ) {
+		++existing->refcount;
+		pthread_mutex_unlock( &registry_lock );
+		free( e->filename );
+		free( e );
+		return existing->font;
+	}
+	e->next = fonts;
+	fonts = e;
+	pthread_mutex_unlock( &registry_lock );
+	return font;
+}
+
+bool font_registry_release_font( font_info_t* font ) {
+	bool last = true;
+	pthread_mutex_lock( &registry_lock );
+	for( font_entry_t** link = &fonts; NULL != *link; link = &(*link)->next ) {
+		font_entry_t* e = *link;
+		if( e->font != font )
+			continue;
+		last = 0 == --e->refcount;
+		if( last ) {
+			*link = e->next;
+			free( e->filename );
+			free( e );
+		}
+		break;
+	}
+	pthread_mutex_unlock( &registry_lock );
+	return last;
+}
+
+// Call with the registry locked
+static font_entry_t* font_registry_find_entry( const char* path, unsigned int height, bool sdf,
+		unsigned int subpixel_phases, unsigned int first_codepoint, unsigned int last_codepoint ) {
+	font_entry_t* e = fonts;
+	while( NULL != e && !( e->height == height && e->sdf == sdf && e->subpixel_phases == subpixel_phases &&
+			e->first_codepoint == first_codepoint &&
+			e->last_codepoint == last_codepoint && 0 == strcmp( e->filename, path ) ) )
+		e = e->next;
+	return e;
+}
+
+// Maps the file and opens the face. Call with the registry locked
+static bool font_registry_open_face( font_face_t* f ) {
+	const int fd = open( f->filename, O_RDONLY );
+	if( fd < 0 ) {
+		fprintf( stderr, "Failed to open font file '%s'\n", f->filename );
+		return false;
+	}
+	struct stat st;
+	if( 0 != fstat( fd, &st ) || 0 == st.st_size ) {
+		fprintf( stderr, "Font file '%s' is empty\n", f->filename );
+		close( fd );
+		return false;
+	}
+	f->data_size = (size_t)st.st_size;
+	f->data = mmap( NULL, f->data_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if( MAP_FAILED == f->data ) {
+		fprintf( stderr, "Failed to map font file '%s'\n", f->filename );
+		return false;
+	}
+	bool ok = true;
+	if( FT_New_Memory_Face( ft, f->data, (FT_Long)f->data_size, 0, &f->face ) ) {
+		fprintf( stderr, "Failed to load font face from '%s'\n", f->filename );
+		f->face = NULL;
+		ok = false;
+	}
+	if( ok && !( f->face->face_flags & FT_FACE_FLAG_SCALABLE ) ) {
+		fprintf( stderr, "Font '%s' is not scalable\n", f->filename );
+		ok = false;
+	}
+	if( ok && NULL == f->face->charmap ) {
+		fprintf( stderr, "Font '%s' seems to have no unicode charmap\n", f->filename );
+		ok = false;
+	}
+	if( !ok ) {
+		if( NULL != f->face )
+			FT_Done_Face( f->face );
+		munmap( (void*)f->data, f->data_size );
+	}
+	return ok;
+}
+
+// Same file, same key. Falls back to the name as given if the path cannot be resolved
+static void font_registry_canonical( const char* filename, char* out ) {
+	if( NULL == realpath( filename, out ) ) {
+		strncpy( out, filename, PATH_MAX - 1 );
+		out[PATH_MAX - 1] = '\0';
+	}
+}
@@ -0,0 +1,58 @@
+/*
+ * Registry of font files and fonts. All faces share one FreeType library, every font file
+ * is memory mapped and opened once (FT_New_Memory_Face) and serves any number of pixel
+ * sizes through FT_Size objects. Identical font requests return the same font.
+ * Everything is reference counted and safe to call from several threads.
+ */
+
+#pragma once
+
+#include "font.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_SIZES_H
+
+typedef struct font_face_s font_face_t;
+
+struct font_face_s {
+	// Canonical path of the font file
+	char* filename;
+	const unsigned char* data;
+	size_t data_size;
+	FT_Face face;
+	// A face and its glyph slot must only be used by one thread at a time, see font_face_lock()
+	pthread_mutex_t lock;
+	unsigned int refcount;
+	font_face_t* next;
+};
+
+/* Returns the shared face of a font file, maps and opens the file on first use.
+ * Checks that the face is scalable and has a unicode charmap. NULL on failure */
+font_face_t* font_registry_acquire_face( const char* filename );
+
+/* Drops a reference, the last one closes the face and unmaps the file */
+void font_registry_release_face( font_face_t* f );
+
+/* Creates a size object of height pixels for the face. Call with the face locked */
+FT_Size font_face_new_size( font_face_t* f, unsigned int height );
+
+/* Locks the face and makes size the active one, if not NULL */
+void font_face_lock( font_face_t* f, FT_Size size );
+
+void font_face_unlock( font_face_t* f );
+
+/* Returns a font created before with identical parameters and adds a reference, or NULL */
+font_info_t* font_registry_find_font( const char* filename, unsigned int height, bool sdf,
+		unsigned int subpixel_phases, unsigned int first_codepoint, unsigned int last_codepoint );
+
+/* Registers a new font for font_registry_find_font(), with one reference.
+ * If another thread registered an identical font in the meantime, that one is returned
+ * with a reference added and the caller destroys its own */
+font_info_t* font_registry_add_font( font_info_t* font, const char* filename, unsigned int height, bool sdf,
+		unsigned int subpixel_phases, unsigned int first_codepoint, unsigned int last_codepoint );
+
+/* Drops a reference. Returns true if that was the last one and the font must be destroyed.
+ * Fonts that were never registered always return true */
+bool font_registry_release_font( font_info_t* font );
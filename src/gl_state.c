@@ -0,0 +1,164 @@
+
+#include "gl_state.h"
+
+// Every value is only valid while its flag is set, after gl_state_invalidate() none is
+typedef struct {
+	bool program_known;
+	GLuint program;
+	bool vertex_array_known;
+	GLuint vertex_array;
+	bool textures_known[GL_STATE_TEXTURE_UNITS];
+	GLuint textures[GL_STATE_TEXTURE_UNITS];
+	bool uniform_buffers_known[GL_STATE_UNIFORM_BUFFERS];
+	GLuint uniform_buffers[GL_STATE_UNIFORM_BUFFERS];
+	bool blend_known;
+	bool blend;
+	// GL keeps factors and box while the test is disabled
+	bool blend_func_known;
+	GLenum blend_src;
+	GLenum blend_dst;
+	bool scissor_known;
+	bool scissor;
+	bool scissor_box_known;
+	GLint scissor_box[4];
+} gl_state_t;
+
+static gl_state_t state;
+static gl_state_stats_t stats;
+// False when there is no context, see gl_state_set_available()
+static bool gl_available = true;
+
+// Counts a request, true if it changes nothing and is skipped
+static inline bool gl_state_skip( bool unchanged ) {
+	++stats.calls;
+	if( unchanged )
+		++stats.skipped;
+	return unchanged;
+}
+
+void gl_state_use_program( GLuint program ) {
+	if( gl_state_skip( state.program_known && state.program == program ) )
+		return;
+	glUseProgram( program );
+	state.program = program;
+	state.program_known = true;
+}
+
+void gl_state_bind_vertex_array( GLuint vertex_array ) {
+	if( gl_state_skip( state.vertex_array_known && state.vertex_array == vertex_array ) )
+		return;
+	glBindVertexArray( vertex_array );
+	state.vertex_array = vertex_array;
+	state.vertex_array_known = true;
+}
+
+void gl_state_bind_texture_unit( GLuint unit, GLuint texture ) {
+	if( unit >= GL_STATE_TEXTURE_UNITS ) {
+		++stats.calls;
+		glBindTextureUnit( unit, texture );
+		return;
+	}
+	if( gl_state_skip( state.textures_known[unit] && state.textures[unit] == texture ) )
+		return;
+	glBindTextureUnit( unit, texture );
+	state.textures[unit] = texture;
+	state.textures_known[unit] = true;
+}
+
+void gl_state_bind_uniform_buffer( GLuint index, GLuint buffer ) {
+	if( index >= GL_STATE_UNIFORM_BUFFERS ) {
+		++stats.calls;
+		glBindBufferBase( GL_UNIFORM_BUFFER, index, buffer );
+		return;
+	}
+	if( gl_state_skip( state.uniform_buffers_known[index] && state.uniform_buffers[index] == buffer ) )
+		return;
+	glBindBufferBase( GL_UNIFORM_BUFFER, index, buffer );
+	state.uniform_buffers[index] = buffer;
+	state.uniform_buffers_known[index] = true;
+}
+
+void gl_state_blend( bool enable, GLenum src_factor, GLenum dst_factor ) {
+	const bool same_func = state.blend_func_known && state.blend_src == src_factor && state.blend_dst == dst_factor;
+	if( gl_state_skip( state.blend_known && state.blend == enable && ( !enable || same_func ) ) )
+		return;
+	if( !state.blend_known || state.blend != enable ) {
+		if( enable )
+			glEnable( GL_BLEND );
+		else
+			glDisable( GL_BLEND );
+		state.blend = enable;
+		state.blend_known = true;
+	}
+	if( enable && !same_func ) {
+		glBlendFunc( src_factor, dst_factor );
+		state.blend_src = src_factor;
+		state.blend_dst = dst_factor;
+		state.blend_func_known = true;
+	}
+}
+
+void gl_state_scissor( bool enable, GLint x, GLint y, GLsizei width, GLsizei height ) {
+	const bool same_box = state.scissor_box_known && state.scissor_box[0] == x && state.scissor_box[1] == y &&
+			state.scissor_box[2] == width && state.scissor_box[3] == height;
+	if( gl_state_skip( state.scissor_known && state.scissor == enable && ( !enable || same_box ) ) )
+		return;
+	if( !state.scissor_known || state.scissor != enable ) {
+		if( enable )
+			glEnable( GL_SCISSOR_TEST );
+		else
+			glDisable( GL_SCISSOR_TEST );
+		state.scissor = enable;
+		state.scissor_known = true;
+	}
+	if( enable && !same_box ) {
+		glScissor( x, y, width, height );
+		state.scissor_box[0] = x;
+		state.scissor_box[1] = y;
+		state.scissor_box[2] = width;
+		state.scissor_box[3] = height;
+		state.scissor_box_known = true;
+	}
+}
+
+void gl_state_invalidate() {
+	const gl_state_t unknown = { 0 };
+	state = unknown;
+}
+
+void gl_state_forget_program( GLuint program ) {
+	if( state.program_known && state.program == program )
+		state.program_known = false;
+}
+
+void gl_state_forget_vertex_array( GLuint vertex_array ) {
+	// GL falls back to no vertex array
+	if( state.vertex_array_known && state.vertex_array == vertex_array )
+		state.vertex_array = 0;
+}
+
+void gl_state_forget_texture( GLuint texture ) {
+	// GL binds texture 0 to every unit that had the deleted one
+	for( int i = 0; i < GL_STATE_TEXTURE_UNITS; ++i )
+		if( state.textures_known[i] && state.textures[i] == texture )
+			state.textures[i] = 0;
+}
+
+void gl_state_forget_buffer( GLuint buffer ) {
+	// GL resets every binding of the deleted buffer to 0
+	for( int i = 0; i < GL_STATE_UNIFORM_BUFFERS; ++i )
+		if( state.uniform_buffers_known[i] && state.uniform_buffers[i] == buffer )
+			state.uniform_buffers[i] = 0;
+}
+
+void gl_state_stats( gl_state_stats_t* out_stats ) {
+	*out_stats = stats;
+}
+
+void gl_state_set_available( bool available ) {
+	gl_available = available;
+}
+
+bool gl_state_available() {
+	return gl_available;
+}
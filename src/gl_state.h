@@ -0,0 +1,55 @@
+/*
+ * Shadow of the GL state the gui touches: program, vertex array, texture units, uniform buffer
+ * bindings, blending and scissor test. Calls that would set what is already set are skipped and counted.
+ * The shadow belongs to the current context. A host renderer that changes any of this state
+ * directly calls gl_state_invalidate() before the gui draws again, or goes through these
+ * functions itself. Deleting a tracked object must be reported with the forget functions,
+ * GL may hand out its name again.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "glad/glad.h"
+
+// Tracked texture units and uniform buffer binding points, higher ones are passed through
+#define GL_STATE_TEXTURE_UNITS 16
+#define GL_STATE_UNIFORM_BUFFERS 16
+
+typedef struct {
+	// State changes requested, and those skipped because nothing would change
+	unsigned long calls;
+	unsigned long skipped;
+} gl_state_stats_t;
+
+void gl_state_use_program( GLuint program );
+
+void gl_state_bind_vertex_array( GLuint vertex_array );
+
+void gl_state_bind_texture_unit( GLuint unit, GLuint texture );
+
+/* Binds the whole buffer to the indexed uniform buffer binding point */
+void gl_state_bind_uniform_buffer( GLuint index, GLuint buffer );
+
+/* Enables blending with the factors, or disables it. Factors are ignored when disabled */
+void gl_state_blend( bool enable, GLenum src_factor, GLenum dst_factor );
+
+/* Enables the scissor test with the box, or disables it. The box is ignored when disabled */
+void gl_state_scissor( bool enable, GLint x, GLint y, GLsizei width, GLsizei height );
+
+/* Forgets everything, the next call of each kind goes to GL */
+void gl_state_invalidate();
+
+/* Objects about to be deleted. GL unbinds them, so does the shadow */
+void gl_state_forget_program( GLuint program );
+void gl_state_forget_vertex_array( GLuint vertex_array );
+void gl_state_forget_texture( GLuint texture );
+void gl_state_forget_buffer( GLuint buffer );
+
+void gl_state_stats( gl_state_stats_t* out_stats );
+
+/* Without a context fonts and windows are made for the software renderer only, see gui_soft.h.
+ * They keep their glyphs on the CPU and make no GL calls. Set before the first font or window
+ * is created, GL is available by default */
+void gl_state_set_available( bool available );
+bool gl_state_available();
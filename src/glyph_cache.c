@@ -0,0 +1,243 @@
+
+#include "glyph_cache.h"
+#include "sdf.h"
+#include "font_atlas.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+static const glyph_info_t* glyph_cache_load( glyph_cache_t* c, unsigned int codepoint, bool pin, bool* retry );
+static int glyph_cache_find( const glyph_cache_t* c, unsigned int codepoint );
+static int glyph_cache_take_cell( glyph_cache_t* c );
+static void glyph_cache_lru_unlink( glyph_cache_t* c, int index );
+static void glyph_cache_lru_push_front( glyph_cache_t* c, int index );
+
+static inline int glyph_cache_bucket( const glyph_cache_t* c, unsigned int codepoint ) {
+	// Fibonacci hashing, the top bits of the product are the best mixed
+	return (int)( ( codepoint * 2654435769u ) >> c->bucket_shift );
+}
+
+glyph_cache_t* glyph_cache_create( font_face_t* face, FT_Size size, int layer,
+		unsigned int texture_width, unsigned int texture_height,
+		int origin_x, int origin_y, unsigned char* pixels, int stride,
+		int cell_width, int cell_height, int columns, int rows, int sdf_spread, bool subpixel ) {
+	if( columns < 1 || rows < 1 ) {
+		fputs( "Glyph cache needs at least one cell\n", stderr );
+		return NULL;
+	}
+	glyph_cache_t* c = calloc( 1, sizeof( glyph_cache_t ) );
+	if( NULL == c )
+		return NULL;
+	c->num_entries = columns * rows;
+	// At least 2 buckets, a shift by 32 would be undefined
+	c->num_buckets = 2;
+	c->bucket_shift = 31;
+	while( c->num_buckets < 2 * c->num_entries ) {
+		c->num_buckets <<= 1;
+		--c->bucket_shift;
+	}
+	c->entries = calloc( (size_t)c->num_entries, sizeof( glyph_cache_entry_t ) );
+	c->buckets = malloc( (size_t)c->num_buckets * sizeof( int ) );
+	if( NULL == c->entries || NULL == c->buckets ) {
+		free( c->entries );
+		free( c->buckets );
+		free( c );
+		return NULL;
+	}
+	for( int i = 0; i < c->num_buckets; ++i )
+		c->buckets[i] = -1;
+	c->face = face;
+	c->size = size;
+	c->layer = layer;
+	c->texture_width = texture_width;
+	c->texture_height = texture_height;
+	c->origin_x = origin_x;
+	c->origin_y = origin_y;
+	c->pixels = pixels;
+	c->stride = stride;
+	c->cell_width = cell_width;
+	c->cell_height = cell_height;
+	c->columns = columns;
+	c->rows = rows;
+	c->sdf_spread = sdf_spread;
+	c->subpixel = subpixel;
+	c->lru_head = c->lru_tail = -1;
+	return c;
+}
+
+const glyph_info_t* glyph_cache_get( glyph_cache_t* c, unsigned int codepoint, bool pin ) {
+	bool retry = false;
+	return glyph_cache_load( c, codepoint, pin, &retry );
+}
+
+bool glyph_cache_pin( glyph_cache_t* c, unsigned int codepoint ) {
+	bool retry = false;
+	return NULL != glyph_cache_load( c, codepoint, true, &retry ) || !retry;
+}
+
+// Looks the glyph up or loads it into a cell. retry is set if it failed for now but could be
+// cached later, every cell was pinned or memory ran out
+static const glyph_info_t* glyph_cache_load( glyph_cache_t* c, unsigned int codepoint, bool pin, bool* retry ) {
+	int index = glyph_cache_find( c, codepoint );
+	if( index >= 0 ) {
+		++c->stats.hits;
+		glyph_cache_entry_t* e = &c->entries[index];
+		if( pin )
+			++e->pins;
+		if( index != c->lru_head ) {
+			glyph_cache_lru_unlink( c, index );
+			glyph_cache_lru_push_front( c, index );
+		}
+		return &e->glyph;
+	}
+	++c->stats.misses;
+	// The glyph slot belongs to the shared face, it stays locked until the bitmap is uploaded
+	font_face_lock( c->face, c->size );
+	if( FT_Load_Char( c->face->face, codepoint, FT_LOAD_RENDER | ( c->subpixel ? FT_LOAD_TARGET_LIGHT : 0 ) ) ) {
+		font_face_unlock( c->face );
+		fprintf( stderr, "Failed to load glyph U+%04X\n", codepoint );
+		return NULL;
+	}
+	const FT_GlyphSlot g = c->face->face->glyph;
+	const bool empty = 0 == g->bitmap.width || 0 == g->bitmap.rows;
+	const int width = empty ? 0 : (int)g->bitmap.width + 2 * c->sdf_spread;
+	const int height = empty ? 0 : (int)g->bitmap.rows + 2 * c->sdf_spread;
+	if( width > c->cell_width - FONT_ATLAS_PADDING || height > c->cell_height - FONT_ATLAS_PADDING ) {
+		font_face_unlock( c->face );
+		fprintf( stderr, "Glyph U+%04X exceeds the cache cell size\n", codepoint );
+		return NULL;
+	}
+	unsigned char* sdf = NULL;
+	if( c->sdf_spread > 0 && !empty ) {
+		sdf = malloc( (size_t)( width * height ) );
+		if( NULL == sdf || !sdf_generate( g->bitmap.buffer, (int)g->bitmap.width, (int)g->bitmap.rows,
+				g->bitmap.pitch, c->sdf_spread, sdf ) ) {
+			font_face_unlock( c->face );
+			fprintf( stderr, "Out of memory generating distance field for U+%04X\n", codepoint );
+			free( sdf );
+			*retry = true;
+			return NULL;
+		}
+	}
+	index = glyph_cache_take_cell( c );
+	if( index < 0 ) {
+		font_face_unlock( c->face );
+		fputs( "Glyph cache full, all glyphs are pinned\n", stderr );
+		free( sdf );
+		*retry = true;
+		return NULL;
+	}
+	const int x = c->origin_x + ( index % c->columns ) * c->cell_width;
+	const int y = c->origin_y + ( index / c->columns ) * c->cell_height;
+	// Clear remains of an evicted glyph, they would bleed in with linear filtering
+	const unsigned char* bitmap = NULL != sdf ? sdf : g->bitmap.buffer;
+	unsigned char* cell = c->pixels + (size_t)( index / c->columns ) * (size_t)c->cell_height * (size_t)c->stride +
+			( index % c->columns ) * c->cell_width;
+	for( int row = 0; row < c->cell_height; ++row ) {
+		unsigned char* p = cell + (size_t)row * (size_t)c->stride;
+		memset( p, 0, (size_t)c->cell_width );
+		if( !empty && row < height )
+			memcpy( p, bitmap + (size_t)row * (size_t)width, (size_t)width );
+	}
+	font_atlas_clear( c->layer, x, y, c->cell_width, c->cell_height );
+	if( !empty )
+		font_atlas_upload( c->layer, x, y, width, height, bitmap );
+	free( sdf );
+	glyph_cache_entry_t* e = &c->entries[index];
+	e->codepoint = codepoint;
+	e->pins = pin ? 1 : 0;
+	e->glyph.code = codepoint;
+	e->glyph.ax = c->subpixel ? (float)g->linearHoriAdvance / 65536.0f : (float)(g->advance.x >> 6);
+	e->glyph.ay = (float)(g->advance.y >> 6);
+	e->glyph.size_x = (float)width;
+	e->glyph.size_y = (float)height;
+	e->glyph.bearing_x = (float)( g->bitmap_left - c->sdf_spread );
+	e->glyph.bearing_y = (float)( g->bitmap_top + c->sdf_spread );
+	e->glyph.offset_x = (float)x / (float)c->texture_width;
+	e->glyph.offset_y = (float)y / (float)c->texture_height;
+	font_face_unlock( c->face );
+	const int bucket = glyph_cache_bucket( c, codepoint );
+	e->hash_next = c->buckets[bucket];
+	c->buckets[bucket] = index;
+	glyph_cache_lru_push_front( c, index );
+	return &e->glyph;
+}
+
+void glyph_cache_unpin( glyph_cache_t* c, unsigned int codepoint ) {
+	const int index = glyph_cache_find( c, codepoint );
+	if( index >= 0 && c->entries[index].pins > 0 )
+		--c->entries[index].pins;
+}
+
+void glyph_cache_set_texture_size( glyph_cache_t* c, unsigned int texture_width, unsigned int texture_height ) {
+	for( unsigned long i = 0; i < c->stats.glyphs; ++i ) {
+		glyph_info_t* g = &c->entries[i].glyph;
+		g->offset_x = roundf( g->offset_x * (float)c->texture_width ) / (float)texture_width;
+		g->offset_y = roundf( g->offset_y * (float)c->texture_height ) / (float)texture_height;
+	}
+	c->texture_width = texture_width;
+	c->texture_height = texture_height;
+}
+
+void glyph_cache_delete( glyph_cache_t* c ) {
+	if( NULL == c )
+		return;
+	font_face_lock( c->face, NULL );
+	FT_Done_Size( c->size );
+	font_face_unlock( c->face );
+	font_registry_release_face( c->face );
+	free( c->entries );
+	free( c->buckets );
+	free( c );
+}
+
+static int glyph_cache_find( const glyph_cache_t* c, unsigned int codepoint ) {
+	for( int i = c->buckets[glyph_cache_bucket( c, codepoint )]; i >= 0; i = c->entries[i].hash_next )
+		if( c->entries[i].codepoint == codepoint )
+			return i;
+	return -1;
+}
+
+// Returns a free cell, or evicts the least recently used glyph that is not pinned
+static int glyph_cache_take_cell( glyph_cache_t* c ) {
+	if( c->stats.glyphs < (unsigned long)c->num_entries )
+		return (int)c->stats.glyphs++;
+	int index = c->lru_tail;
+	while( index >= 0 && c->entries[index].pins > 0 )
+		index = c->entries[index].lru_prev;
+	if( index < 0 )
+		return -1;
+	// Remove from the hash chain and the LRU list
+	const int bucket = glyph_cache_bucket( c, c->entries[index].codepoint );
+	int* link = &c->buckets[bucket];
+	while( *link != index )
+		link = &c->entries[*link].hash_next;
+	*link = c->entries[index].hash_next;
+	glyph_cache_lru_unlink( c, index );
+	++c->stats.evictions;
+	return index;
+}
+
+static void glyph_cache_lru_unlink( glyph_cache_t* c, int index ) {
+	glyph_cache_entry_t* e = &c->entries[index];
+	if( e->lru_prev >= 0 )
+		c->entries[e->lru_prev].lru_next = e->lru_next;
+	else
+		c->lru_head = e->lru_next;
+	if( e->lru_next >= 0 )
+		c->entries[e->lru_next].lru_prev = e->lru_prev;
+	else
+		c->lru_tail = e->lru_prev;
+}
+
+static void glyph_cache_lru_push_front( glyph_cache_t* c, int index ) {
+	glyph_cache_entry_t* e = &c->entries[index];
+	e->lru_prev = -1;
+	e->lru_next = c->lru_head;
+	if( c->lru_head >= 0 )
+		c->entries[c->lru_head].lru_prev = index;
+	c->lru_head = index;
+	if( c->lru_tail < 0 )
+		c->lru_tail = index;
+}
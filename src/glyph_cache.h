@@ -0,0 +1,84 @@
+/*
+ * On demand glyph cache for codepoints outside the prebuilt ASCII atlas.
+ * The cache page is a fixed grid of equally sized cells inside the font's atlas texture.
+ * Glyphs are rasterized on first use and uploaded into a free cell, when the page is full
+ * the least recently used glyph that is not pinned is evicted.
+ */
+
+#pragma once
+
+#include "font.h"
+#include "font_registry.h"
+
+typedef struct {
+	glyph_info_t glyph;
+	unsigned int codepoint;
+	// LRU list, head is the most recently used glyph
+	int lru_prev;
+	int lru_next;
+	// Next entry in the same hash bucket
+	int hash_next;
+	// Pins taken by vertices that are not regenerated, the glyph is not evicted while there are any
+	unsigned int pins;
+} glyph_cache_entry_t;
+
+struct glyph_cache_s {
+	// The cache holds a reference to the shared face and owns the font's size object
+	font_face_t* face;
+	FT_Size size;
+	// Layer of the font in the atlas texture array
+	int layer;
+	unsigned int texture_width;
+	unsigned int texture_height;
+	// Upper left of the cache page in the atlas and the cell grid
+	int origin_x;
+	int origin_y;
+	int cell_width;
+	int cell_height;
+	int columns;
+	int rows;
+	// Upper left of the cache page in the font's CPU image and the image's row length
+	unsigned char* pixels;
+	int stride;
+	// Distance field border for sdf fonts, else 0
+	int sdf_spread;
+	// Unhinted glyphs with fractional advances for subpixel positioned fonts
+	bool subpixel;
+	// One entry per cell
+	glyph_cache_entry_t* entries;
+	int num_entries;
+	int* buckets;
+	// A power of 2, the hash is shifted right by 32 - log2( num_buckets )
+	int num_buckets;
+	int bucket_shift;
+	int lru_head;
+	int lru_tail;
+	font_cache_stats_t stats;
+};
+
+/* Creates a cache page of columns * rows cells with the upper left at origin_x, origin_y in the atlas layer
+ * and at pixels in the font's CPU image with rows of stride bytes.
+ * Glyphs are converted to distance fields if sdf_spread > 0, subpixel loads them like the
+ * preloaded glyphs of subpixel positioned fonts, in phase 0 only. Takes over the face reference
+ * and size. Returns NULL on failure, face and size are then still owned by the caller */
+glyph_cache_t* glyph_cache_create( font_face_t* face, FT_Size size, int layer,
+		unsigned int texture_width, unsigned int texture_height,
+		int origin_x, int origin_y, unsigned char* pixels, int stride,
+		int cell_width, int cell_height, int columns, int rows, int sdf_spread, bool subpixel );
+
+/* Returns the glyph for codepoint, rasterizes and uploads it on a miss. pin takes a pin on it.
+ * NULL if the glyph could not be loaded or every cell is pinned, no pin is taken then */
+const glyph_info_t* glyph_cache_get( glyph_cache_t* c, unsigned int codepoint, bool pin );
+
+/* Takes a pin on the codepoint's glyph, loads it on a miss. False if no pin was taken but the glyph
+ * could be cached later, every cell is pinned or memory ran out. True without a pin for codepoints
+ * that can not be loaded or do not fit a cell, they are never cached and unpinning them does nothing */
+bool glyph_cache_pin( glyph_cache_t* c, unsigned int codepoint );
+
+/* Drops a pin of the codepoint's glyph, nothing if it is not cached or not pinned */
+void glyph_cache_unpin( glyph_cache_t* c, unsigned int codepoint );
+
+/* Renormalizes the texture coordinates of the cached glyphs after the atlas layers grew */
+void glyph_cache_set_texture_size( glyph_cache_t* c, unsigned int texture_width, unsigned int texture_height );
+
+void glyph_cache_delete( glyph_cache_t* c );
@@ -1,14 +1,35 @@
-
 #version 450 core
 
-// .x/.y = screen- and .z/.w = texture coords
-layout( location = 0 ) in vec4 vertex;
-out vec2 tex_coords;
+// One instance per glyph: lower left and size of the quad relative to the window's upper left
+layout( location = 0 ) in vec4 rect;
+// Left, top, width and height of the glyph in its atlas layer in texels
+layout( location = 1 ) in uvec4 texel_rect;
+// Layer of the font in the atlas texture array in the low 16 bits, the window's slot above
+layout( location = 2 ) in uint layer;
+out vec3 tex_coords;
+// The window's text color
+flat out vec3 pen_color;
 
-uniform mat4 projection;
+layout( binding = 0 ) uniform sampler2DArray texture_atlas;
+// Shared by all gui programs and windows, see gui_resize() and gui_window_move()
+layout( std140, binding = 0 ) uniform gui_frame {
+	mat4 projection;
+	// Screen position of the windows' upper left corners, two per element
+	vec4 origins[512];
+	// Text colors of the windows as RGBA8, four per element
+	uvec4 colors[256];
+};
 uniform int buffer_number;
 
 void main() {	
-	gl_Position = projection * vec4( vertex.xy, 0.0, 1.0 );
-	tex_coords = vertex.zw;
+	// Triangle strip corners from the vertex id: lower left, lower right, upper left, upper right
+	const vec2 corner = vec2( gl_VertexID & 1, gl_VertexID >> 1 );
+	const uint slot = layer >> 16;
+	const vec4 pair = origins[slot >> 1];
+	const vec2 origin = 0u == ( slot & 1u ) ? pair.xy : pair.zw;
+	gl_Position = projection * vec4( origin + rect.xy + rect.zw * corner, 0.0, 1.0 );
+	pen_color = unpackUnorm4x8( colors[slot >> 2][slot & 3u] ).rgb;
+	// Atlas rows run top down
+	const vec2 texel = vec2( texel_rect.xy ) + vec2( texel_rect.zw ) * vec2( corner.x, 1.0 - corner.y );
+	tex_coords = vec3( texel / vec2( textureSize( texture_atlas, 0 ).xy ), float( layer & 0xffffu ) );
 }
@@ -0,0 +1,16 @@
+#version 450 core
+
+// Distance field variant of glyph_shader.fs. The atlas holds 0.5 on the outline,
+// the screen space derivative keeps the edge about one pixel wide at any scale
+in vec3 tex_coords;
+flat in vec3 pen_color;
+out vec4 color;
+
+layout( binding = 0 ) uniform sampler2DArray texture_atlas;
+
+void main() {
+	float d = texture( texture_atlas, tex_coords ).r;
+	float width = fwidth( d );
+	float alpha = smoothstep( 0.5f - width, 0.5f + width, d );
+	color = vec4( pen_color, alpha );
+}
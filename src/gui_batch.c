@@ -0,0 +1,255 @@
+
+#include "gui_batch.h"
+#include "font_atlas.h"
+#include "gl_state.h"
+#include "gui_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// memcpy()
+
+// Coverage and distance field program
+#define GUI_BATCH_PROGRAMS 2
+
+// A window's instances in the shared buffers
+typedef struct {
+	GLuint static_first;
+	// Static glyphs copied, the window's count when it was gathered
+	GLsizei static_count;
+	GLuint dynamic_first;
+	GLsizei dynamic_count;
+	// Drawn on its own with the scissor test, after the unclipped windows of its program
+	bool clipped;
+} gui_batch_window_t;
+
+// Registered windows in order of gui_window_end()
+static gui_window_t** windows = NULL;
+static gui_batch_window_t* ranges = NULL;
+static int num_windows = 0;
+static int max_windows = 0;
+// The set of windows changed, the shared buffers must be gathered again
+static bool dirty = true;
+static GLuint vertex_array = 0;
+static GLuint static_buffer = 0;
+static vertex_ring_t dynamic_ring;
+// Sum of the windows' dynamic generations in the ring's current region
+static unsigned long uploaded_generation = 0;
+// Instance ranges of the unclipped windows per program
+static GLuint static_first[GUI_BATCH_PROGRAMS];
+static GLsizei static_count[GUI_BATCH_PROGRAMS];
+static GLuint dynamic_first[GUI_BATCH_PROGRAMS];
+static GLsizei dynamic_count[GUI_BATCH_PROGRAMS];
+
+static inline int gui_batch_program_index( const gui_window_t* w ) {
+	return w->font->sdf_spread > 0 ? 1 : 0;
+}
+
+bool gui_batch_add_window( gui_window_t* w ) {
+	if( num_windows == max_windows ) {
+		const int n = max_windows > 0 ? 2 * max_windows : 8;
+		gui_window_t** p = realloc( windows, (size_t)n * sizeof( gui_window_t* ) );
+		if( NULL != p )
+			windows = p;
+		gui_batch_window_t* r = NULL != p ? realloc( ranges, (size_t)n * sizeof( gui_batch_window_t ) ) : NULL;
+		if( NULL == r ) {
+			fputs( "Out of memory for gui batch windows\n", stderr );
+			return false;
+		}
+		ranges = r;
+		max_windows = n;
+	}
+	windows[num_windows++] = w;
+	dirty = true;
+	return true;
+}
+
+void gui_batch_remove_window( const gui_window_t* w ) {
+	int i = 0;
+	while( i < num_windows && windows[i] != w )
+		++i;
+	if( i == num_windows )
+		return;
+	memmove( &windows[i], &windows[i + 1], (size_t)( num_windows - i - 1 ) * sizeof( gui_window_t* ) );
+	memmove( &ranges[i], &ranges[i + 1], (size_t)( num_windows - i - 1 ) * sizeof( gui_batch_window_t ) );
+	--num_windows;
+	dirty = true;
+	if( 0 == num_windows ) {
+		if( 0 != vertex_array )
+			vertex_ring_delete( &dynamic_ring );
+		if( glIsBuffer( static_buffer ) )
+			glDeleteBuffers( 1, &static_buffer );
+		if( glIsVertexArray( vertex_array ) ) {
+			gl_state_forget_vertex_array( vertex_array );
+			glDeleteVertexArrays( 1, &vertex_array );
+		}
+		static_buffer = vertex_array = 0;
+		free( windows );
+		free( ranges );
+		windows = NULL;
+		ranges = NULL;
+		max_windows = 0;
+	}
+}
+
+// True if window i is in the group of program p that is clipped or not
+static inline bool gui_batch_in_group( int i, int p, bool clipped ) {
+	return gui_batch_program_index( windows[i] ) == p && windows[i]->internals->clipped == clipped;
+}
+
+// Copies all static glyphs into one buffer on the GPU and sizes the ring for the dynamic ones.
+// Per program the unclipped windows come first, so they are drawn at once
+static bool gui_batch_gather() {
+	if( 0 == vertex_array ) {
+		gui_glyph_vertex_array_create( &vertex_array );
+		glCreateBuffers( 1, &static_buffer );
+	} else
+		vertex_ring_delete( &dynamic_ring );
+	GLsizei total_static = 0, total_dynamic = 0;
+	for( int i = 0; i < num_windows; ++i ) {
+		total_static += windows[i]->internals->num_static_glyphs;
+		total_dynamic += windows[i]->internals->dynamic_elements.num_slot_glyphs;
+	}
+	glNamedBufferData( static_buffer, (GLsizeiptr)total_static * (GLsizeiptr)sizeof( gui_glyph_t ), NULL, GL_STATIC_DRAW );
+	GLuint first = 0;
+	for( int p = 0; p < GUI_BATCH_PROGRAMS; ++p ) {
+		static_first[p] = first;
+		for( int c = 0; c < 2; ++c ) {
+			for( int i = 0; i < num_windows; ++i ) {
+				gui_window_internals_t* in = windows[i]->internals;
+				if( !gui_batch_in_group( i, p, 1 == c ) )
+					continue;
+				ranges[i].static_first = first;
+				ranges[i].static_count = in->num_static_glyphs;
+				ranges[i].clipped = in->clipped;
+				in->static_dirty_first = in->static_dirty_end = 0;
+				if( 0 == in->num_static_glyphs )
+					continue;
+				glCopyNamedBufferSubData( in->static_glyph_buffer, static_buffer, 0,
+						(GLintptr)first * (GLintptr)sizeof( gui_glyph_t ),
+						(GLsizeiptr)in->num_static_glyphs * (GLsizeiptr)sizeof( gui_glyph_t ) );
+				first += (GLuint)in->num_static_glyphs;
+			}
+			if( 0 == c )
+				static_count[p] = (GLsizei)( first - static_first[p] );
+		}
+	}
+	if( !vertex_ring_create( &dynamic_ring, (GLsizeiptr)total_dynamic * (GLsizeiptr)sizeof( gui_glyph_t ),
+			GUI_FRAMES_IN_FLIGHT ) )
+		return false;
+	dirty = false;
+	return true;
+}
+
+// Copies the glyphs of all dynamic elements to the next ring region, packed like the static ones
+static bool gui_batch_upload( unsigned long generation ) {
+	gui_glyph_t* buf = vertex_ring_begin( &dynamic_ring );
+	if( NULL == buf )
+		return false;
+	GLuint first = 0;
+	for( int p = 0; p < GUI_BATCH_PROGRAMS; ++p ) {
+		dynamic_first[p] = first;
+		for( int c = 0; c < 2; ++c ) {
+			for( int i = 0; i < num_windows; ++i ) {
+				const gui_window_internals_t* in = windows[i]->internals;
+				const gui_dynamic_elements_t* d = &(in->dynamic_elements);
+				if( !gui_batch_in_group( i, p, 1 == c ) )
+					continue;
+				ranges[i].dynamic_first = first;
+				for( GLsizei e = 0; e < d->count; ++e ) {
+					memcpy( &buf[first], &in->dynamic_glyph_slots[d->slot_first[e]],
+							(size_t)d->num_glyphs[e] * sizeof( gui_glyph_t ) );
+					gui_stats_count_upload( (size_t)d->num_glyphs[e] * sizeof( gui_glyph_t ) );
+					first += (GLuint)d->num_glyphs[e];
+				}
+				ranges[i].dynamic_count = (GLsizei)( first - ranges[i].dynamic_first );
+			}
+			if( 0 == c )
+				dynamic_count[p] = (GLsizei)( first - dynamic_first[p] );
+		}
+	}
+	uploaded_generation = generation;
+	return true;
+}
+
+// Copies the static glyphs windows changed since the last copy, if their number is the same
+static void gui_batch_patch_static() {
+	for( int i = 0; i < num_windows; ++i ) {
+		gui_window_internals_t* in = windows[i]->internals;
+		if( in->static_dirty_first >= in->static_dirty_end )
+			continue;
+		glCopyNamedBufferSubData( in->static_glyph_buffer, static_buffer,
+				(GLintptr)in->static_dirty_first * (GLintptr)sizeof( gui_glyph_t ),
+				(GLintptr)( ranges[i].static_first + (GLuint)in->static_dirty_first ) * (GLintptr)sizeof( gui_glyph_t ),
+				(GLsizeiptr)( in->static_dirty_end - in->static_dirty_first ) * (GLsizeiptr)sizeof( gui_glyph_t ) );
+		in->static_dirty_first = in->static_dirty_end = 0;
+	}
+}
+
+// Draws instances of the shared static buffer and of the ring's current region
+static void gui_batch_draw( GLuint first_static, GLsizei num_static, GLuint first_dynamic, GLsizei num_dynamic ) {
+	if( num_static > 0 ) {
+		glVertexArrayVertexBuffer( vertex_array, 0, static_buffer, 0, sizeof( gui_glyph_t ) );
+		glDrawArraysInstancedBaseInstance( GL_TRIANGLE_STRIP, 0, 4, num_static, first_static );
+		gui_stats_count_draw( num_static );
+	}
+	if( num_dynamic > 0 ) {
+		glVertexArrayVertexBuffer( vertex_array, 0, dynamic_ring.buffer,
+				vertex_ring_offset( &dynamic_ring ), sizeof( gui_glyph_t ) );
+		glDrawArraysInstancedBaseInstance( GL_TRIANGLE_STRIP, 0, 4, num_dynamic, first_dynamic );
+		gui_stats_count_draw( num_dynamic );
+	}
+}
+
+// Draws all windows, see gui_render_all()
+static void gui_batch_render() {
+	if( 0 == num_windows )
+		return;
+	// Static elements added to a window move the ones after it, a clip rect moves the window
+	for( int i = 0; !dirty && i < num_windows; ++i )
+		dirty = windows[i]->internals->num_static_glyphs != ranges[i].static_count ||
+				windows[i]->internals->clipped != ranges[i].clipped;
+	bool upload = dirty;
+	if( dirty && !gui_batch_gather() )
+		return;
+	gui_batch_patch_static();
+	// Generations only grow, so their sum changes with any of them
+	unsigned long generation = 0;
+	for( int i = 0; i < num_windows; ++i )
+		generation += windows[i]->internals->dynamic_generation;
+	if( ( upload || generation != uploaded_generation ) && !gui_batch_upload( generation ) )
+		return;
+	gui_frame_bind();
+	gl_state_blend( true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+	gl_state_bind_texture_unit( 0, font_atlas_texture() );
+	gl_state_bind_vertex_array( vertex_array );
+	for( int p = 0; p < GUI_BATCH_PROGRAMS; ++p ) {
+		// Any window of the program has it
+		int i = 0;
+		while( i < num_windows && gui_batch_program_index( windows[i] ) != p )
+			++i;
+		if( i == num_windows )
+			continue;
+		gl_state_use_program( gui_window_program( windows[i] ) );
+		gl_state_scissor( false, 0, 0, 0, 0 );
+		gui_batch_draw( static_first[p], static_count[p], dynamic_first[p], dynamic_count[p] );
+		// Clipped windows one by one
+		for( ; i < num_windows; ++i ) {
+			if( !gui_batch_in_group( i, p, true ) )
+				continue;
+			gui_window_scissor( windows[i] );
+			gui_batch_draw( ranges[i].static_first, ranges[i].static_count,
+					ranges[i].dynamic_first, ranges[i].dynamic_count );
+		}
+	}
+	gl_state_scissor( false, 0, 0, 0, 0 );
+	vertex_ring_fence( &dynamic_ring );
+}
+
+void gui_render_all() {
+	const double start = gui_stats_render_begin();
+	gui_batch_render();
+	gui_stats_render_end( start );
+}
+
+void gui_batch_ring_stats( vertex_ring_stats_t* out_stats ) {
+	*out_stats = dynamic_ring.stats;
+}
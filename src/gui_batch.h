@@ -0,0 +1,26 @@
+/*
+ * Batch renderer for all gui windows. gui_window_end() registers a window, gui_render_all()
+ * draws every registered one. Static glyphs are copied on the GPU into a shared buffer, later
+ * only the ranges of replaced or removed static elements, dynamic glyphs into a shared ring
+ * whenever a window's variables changed. Both are grouped by shader program, and all fonts
+ * live in one texture array, so a frame costs at most two instanced draws per program,
+ * whatever the number of windows. Windows with a clip rect add two draws each, they are
+ * drawn after the others with their scissor box.
+ */
+
+#pragma once
+
+#include "gui_window.h"
+
+/* Registers an ended window, called by gui_window_end() */
+bool gui_batch_add_window( gui_window_t* w );
+
+/* Called by gui_window_delete(). The last window takes the batch's buffers with it */
+void gui_batch_remove_window( const gui_window_t* w );
+
+/* Draws all ended windows, each in its color set with gui_window_set_color().
+ * Call gui_window_update() on them before, windows drawn this way need no gui_window_render() */
+void gui_render_all();
+
+/* Frame and fence wait counters of the shared dynamic glyph ring */
+void gui_batch_ring_stats( vertex_ring_stats_t* out_stats );
@@ -0,0 +1,193 @@
+
+#include "gui_format.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>	// rint(), isfinite(), signbit()
+
+// Sign, 20 integer digits, point and fraction
+#define GUI_FORMAT_NUMBER_LENGTH ( 2 + 20 + 1 + GUI_FORMAT_MAX_PRECISION )
+
+static const double powers_of_ten[GUI_FORMAT_MAX_PRECISION + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8
+};
+
+static bool gui_format_literal( gui_format_t* f, unsigned int* n, char c ) {
+	if( *n >= GUI_FORMAT_MAX_LITERALS ) {
+		fprintf( stderr, "Gui format text exceeds %d chars\n", GUI_FORMAT_MAX_LITERALS );
+		return false;
+	}
+	f->literals[(*n)++] = c;
+	return true;
+}
+
+// Parses a decimal number of at most max, advances p
+static bool gui_format_number( const char** p, unsigned int max, unsigned char* out ) {
+	unsigned int v = 0;
+	while( **p >= '0' && **p <= '9' ) {
+		v = 10 * v + (unsigned int)( *(*p)++ - '0' );
+		if( v > max )
+			return false;
+	}
+	*out = (unsigned char)v;
+	return true;
+}
+
+bool gui_format_compile( gui_format_t* f, const char* format ) {
+	memset( f, 0, sizeof( gui_format_t ) );
+	unsigned int n = 0;
+	bool converted = false;
+	for( const char* p = format; '\0' != *p; ) {
+		if( '%' != *p || '%' == p[1] ) {
+			if( !gui_format_literal( f, &n, *p ) )
+				return false;
+			p += '%' == *p ? 2 : 1;
+			continue;
+		}
+		if( converted ) {
+			fprintf( stderr, "Gui format '%s' has more than one conversion\n", format );
+			return false;
+		}
+		converted = true;
+		f->prefix_length = (unsigned char)n;
+		for( ++p; '\0' != *p && NULL != strchr( "-+ 0", *p ); ++p )
+			f->flags |= '-' == *p ? GUI_FORMAT_LEFT : '+' == *p ? GUI_FORMAT_PLUS :
+					' ' == *p ? GUI_FORMAT_SPACE : GUI_FORMAT_ZERO;
+		bool valid = gui_format_number( &p, GUI_FORMAT_MAX_WIDTH, &f->width );
+		if( valid && '.' == *p ) {
+			++p;
+			f->flags |= GUI_FORMAT_PRECISION;
+			valid = gui_format_number( &p, GUI_FORMAT_MAX_PRECISION, &f->precision );
+		}
+		switch( valid ? *p : '\0' ) {
+			case 'd':
+			case 'i':
+				f->conversion = 'd';
+				break;
+			case 'u':
+			case 'x':
+			case 'X':
+			case 'f':
+			case 'F':
+				f->conversion = *p;
+				break;
+			default:
+				fprintf( stderr, "Gui format '%s' is not supported\n", format );
+				return false;
+		}
+		++p;
+		if( !( f->flags & GUI_FORMAT_PRECISION ) )
+			f->precision = gui_format_is_float( f ) ? 6 : 1;
+	}
+	if( !converted ) {
+		fprintf( stderr, "Gui format '%s' has no conversion\n", format );
+		return false;
+	}
+	f->suffix_length = (unsigned char)( n - f->prefix_length );
+	return true;
+}
+
+bool gui_format_is_float( const gui_format_t* f ) {
+	return 'f' == f->conversion || 'F' == f->conversion;
+}
+
+unsigned int gui_format_max_length( const gui_format_t* f ) {
+	// Sign and digits of the largest magnitude: FLT_MAX has 39 integer digits
+	unsigned int number;
+	if( gui_format_is_float( f ) )
+		number = 1 + 39 + ( f->precision > 0 ? 1u + f->precision : 0u );
+	else
+		number = 'x' == f->conversion || 'X' == f->conversion ? 8 : 'u' == f->conversion ? 10 : 11;
+	return f->prefix_length + f->suffix_length + ( f->width > number ? f->width : number );
+}
+
+// Writes at least min_digits digits of v right to left, ending before end. Returns the first
+static char* gui_format_digits( char* end, unsigned long long v, unsigned int base, bool upper, int min_digits ) {
+	const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	char* p = end;
+	while( v > 0 || min_digits > 0 ) {
+		*--p = digits[v % base];
+		v /= base;
+		--min_digits;
+	}
+	return p;
+}
+
+// Pads the sign and digits to the width and writes them between the literals
+static int gui_format_emit( const gui_format_t* f, char sign, const char* digits, int num_digits,
+		bool zero_pad, char* out, size_t size ) {
+	if( 0 == size )
+		return 0;
+	char* o = out;
+	const char* end = out + size - 1;
+	const int len = num_digits + ( '\0' != sign ? 1 : 0 );
+	int pad = f->width > len ? f->width - len : 0;
+	for( int i = 0; i < f->prefix_length && o < end; ++i )
+		*o++ = f->literals[i];
+	if( !( f->flags & GUI_FORMAT_LEFT ) && !zero_pad )
+		for( ; pad > 0 && o < end; --pad )
+			*o++ = ' ';
+	if( '\0' != sign && o < end )
+		*o++ = sign;
+	if( zero_pad )
+		for( ; pad > 0 && o < end; --pad )
+			*o++ = '0';
+	for( int i = 0; i < num_digits && o < end; ++i )
+		*o++ = digits[i];
+	for( ; pad > 0 && o < end; --pad )
+		*o++ = ' ';
+	for( int i = 0; i < f->suffix_length && o < end; ++i )
+		*o++ = f->literals[f->prefix_length + i];
+	*o = '\0';
+	return (int)( o - out );
+}
+
+static char gui_format_sign( const gui_format_t* f, bool negative ) {
+	return negative ? '-' : f->flags & GUI_FORMAT_PLUS ? '+' : f->flags & GUI_FORMAT_SPACE ? ' ' : '\0';
+}
+
+int gui_format_int( const gui_format_t* f, int value, char* out, size_t size ) {
+	char number[GUI_FORMAT_NUMBER_LENGTH];
+	char* end = number + sizeof( number );
+	const bool is_signed = 'd' == f->conversion;
+	const bool negative = is_signed && value < 0;
+	// Magnitude without overflow for INT_MIN, unsigned conversions take the bits
+	const unsigned long long v = negative ? 0ull - (unsigned long long)value :
+			is_signed ? (unsigned long long)value : (unsigned long long)(unsigned int)value;
+	const unsigned int base = 'x' == f->conversion || 'X' == f->conversion ? 16 : 10;
+	const char* digits = gui_format_digits( end, v, base, 'X' == f->conversion, f->precision );
+	// Like printf, a precision turns zero padding off, and unsigned conversions have no sign
+	const bool zero_pad = ( f->flags & GUI_FORMAT_ZERO ) && !( f->flags & ( GUI_FORMAT_LEFT | GUI_FORMAT_PRECISION ) );
+	return gui_format_emit( f, is_signed ? gui_format_sign( f, negative ) : '\0', digits,
+			(int)( end - digits ), zero_pad, out, size );
+}
+
+int gui_format_float( const gui_format_t* f, double value, char* out, size_t size ) {
+	const double scale = powers_of_ten[f->precision];
+	const double scaled = rint( fabs( value ) * scale );
+	// Infinite, NaN or beyond 64 bit integers
+	if( !isfinite( scaled ) || scaled >= 18446744073709551615.0 ) {
+		char spec[16];
+		snprintf( spec, sizeof( spec ), "%%%s%s%s%s%d.%d%c", f->flags & GUI_FORMAT_LEFT ? "-" : "",
+				f->flags & GUI_FORMAT_PLUS ? "+" : "", f->flags & GUI_FORMAT_SPACE ? " " : "",
+				f->flags & GUI_FORMAT_ZERO ? "0" : "", f->width, f->precision, f->conversion );
+		char number[GUI_FORMAT_MAX_WIDTH + 320];
+		snprintf( number, sizeof( number ), spec, value );
+		// Already padded
+		gui_format_t literals_only = *f;
+		literals_only.width = 0;
+		return gui_format_emit( &literals_only, '\0', number, (int)strlen( number ), false, out, size );
+	}
+	char number[GUI_FORMAT_NUMBER_LENGTH];
+	char* end = number + sizeof( number );
+	const unsigned long long u = (unsigned long long)scaled;
+	const unsigned long long p = (unsigned long long)scale;
+	char* digits = end;
+	if( f->precision > 0 ) {
+		digits = gui_format_digits( end, u % p, 10, false, f->precision );
+		*--digits = '.';
+	}
+	digits = gui_format_digits( digits, u / p, 10, false, 1 );
+	const bool zero_pad = ( f->flags & GUI_FORMAT_ZERO ) && !( f->flags & GUI_FORMAT_LEFT );
+	return gui_format_emit( f, gui_format_sign( f, signbit( value ) ), digits,
+			(int)( end - digits ), zero_pad, out, size );
+}
@@ -0,0 +1,52 @@
+/*
+ * Number formatting for gui variables. A printf style format with one conversion is parsed
+ * once into a plan, formatting then runs on integers only instead of parsing the format and
+ * going through the C library every frame.
+ * Supported: literal text, %%, and one %[-+ 0][width][.precision] conversion of d, i, u, x, X
+ * or f, F. Fixed point values are scaled by 10^precision and rounded half to even, so they
+ * match printf exactly for float values up to precision GUI_FORMAT_MAX_PRECISION.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define GUI_FORMAT_MAX_LITERALS 32
+#define GUI_FORMAT_MAX_WIDTH 64
+#define GUI_FORMAT_MAX_PRECISION 8
+// Longest output of any plan, without the terminating 0
+#define GUI_FORMAT_MAX_LENGTH ( GUI_FORMAT_MAX_LITERALS + GUI_FORMAT_MAX_WIDTH )
+
+// Flags of the conversion
+#define GUI_FORMAT_LEFT 0x01		// '-'
+#define GUI_FORMAT_ZERO 0x02		// '0'
+#define GUI_FORMAT_PLUS 0x04		// '+'
+#define GUI_FORMAT_SPACE 0x08		// ' '
+#define GUI_FORMAT_PRECISION 0x10	// precision given
+
+typedef struct {
+	// 'd', 'u', 'x', 'X', 'f' or 'F'
+	char conversion;
+	unsigned char flags;
+	unsigned char width;
+	unsigned char precision;
+	// Text before and after the number, in literals[]
+	unsigned char prefix_length;
+	unsigned char suffix_length;
+	char literals[GUI_FORMAT_MAX_LITERALS];
+} gui_format_t;
+
+/* Parses format into a plan. False if the format is not supported */
+bool gui_format_compile( gui_format_t* f, const char* format );
+
+/* True if the plan formats floating point values */
+bool gui_format_is_float( const gui_format_t* f );
+
+/* Longest output of the plan for any int or float value, without the terminating 0 */
+unsigned int gui_format_max_length( const gui_format_t* f );
+
+/* Format a value like snprintf() with the plan would. Output is truncated to size - 1 chars and
+ * 0-terminated, the length written is returned */
+int gui_format_int( const gui_format_t* f, int value, char* out, size_t size );
+int gui_format_float( const gui_format_t* f, double value, char* out, size_t size );
@@ -0,0 +1,299 @@
+
+#include "gui_soft.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// memcpy()
+#include <math.h>	// floorf(), ceilf()
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+// Pixels of a glyph row sampled before they are blended
+#define GUI_SOFT_SPAN 256
+
+bool gui_soft_framebuffer_create( gui_soft_framebuffer_t* fb, unsigned int width, unsigned int height ) {
+	fb->width = width;
+	fb->height = height;
+	fb->pixels = calloc( (size_t)width * height, 4 );
+	if( NULL == fb->pixels ) {
+		fprintf( stderr, "Out of memory for a %ux%u software framebuffer\n", width, height );
+		return false;
+	}
+	return true;
+}
+
+void gui_soft_framebuffer_delete( gui_soft_framebuffer_t* fb ) {
+	free( fb->pixels );
+	memset( fb, 0, sizeof( gui_soft_framebuffer_t ) );
+}
+
+// Color component 0-1 as byte
+static inline unsigned char gui_soft_byte( float c ) {
+	return (unsigned char)( ( c < 0.0f ? 0.0f : c > 1.0f ? 1.0f : c ) * 255.0f + 0.5f );
+}
+
+void gui_soft_clear( gui_soft_framebuffer_t* fb, const vec3f* color ) {
+	const unsigned char rgba[4] = {
+		gui_soft_byte( color->x ), gui_soft_byte( color->y ), gui_soft_byte( color->z ), 255
+	};
+	const size_t n = (size_t)fb->width * fb->height;
+	for( size_t i = 0; i < n; ++i )
+		memcpy( &fb->pixels[4 * i], rgba, 4 );
+}
+
+/* Blends n pixels of color rgb with coverage alpha over dst like GL_SRC_ALPHA,
+ * GL_ONE_MINUS_SRC_ALPHA: ( src * a + dst * ( 255 - a ) ) / 255 per channel, alpha with src = a.
+ * x / 255 is ( x + 128 + ( ( x + 128 ) >> 8 ) ) >> 8, exact for the products here */
+static void gui_soft_blend_span( unsigned char* restrict dst, const unsigned char* restrict alpha, int n,
+		const unsigned char rgb[3] ) {
+	int i = 0;
+#ifdef __AVX2__
+	const __m256i rgb16 = _mm256_setr_epi16( rgb[0], rgb[1], rgb[2], 0, rgb[0], rgb[1], rgb[2], 0,
+			rgb[0], rgb[1], rgb[2], 0, rgb[0], rgb[1], rgb[2], 0 );
+	const __m256i alpha_lane = _mm256_setr_epi16( 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1 );
+	const __m256i c255 = _mm256_set1_epi16( 255 );
+	const __m256i c128 = _mm256_set1_epi16( 128 );
+	// Each coverage byte to the four channels of its pixel
+	const __m128i spread_lo = _mm_setr_epi8( 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3 );
+	const __m128i spread_hi = _mm_setr_epi8( 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7 );
+	for( ; i + 8 <= n; i += 8 ) {
+		long long a8;
+		memcpy( &a8, &alpha[i], 8 );
+		if( 0 == a8 )
+			continue;
+		const __m128i a = _mm_cvtsi64_si128( a8 );
+		const __m256i d = _mm256_loadu_si256( (const __m256i*)&dst[4 * i] );
+		__m256i t[2];
+		for( int h = 0; h < 2; ++h ) {
+			const __m256i a16 = _mm256_cvtepu8_epi16( _mm_shuffle_epi8( a, 0 == h ? spread_lo : spread_hi ) );
+			const __m256i d16 = _mm256_cvtepu8_epi16( 0 == h ? _mm256_castsi256_si128( d ) : _mm256_extracti128_si256( d, 1 ) );
+			const __m256i s16 = _mm256_or_si256( rgb16, _mm256_and_si256( a16, alpha_lane ) );
+			__m256i x = _mm256_add_epi16( _mm256_mullo_epi16( s16, a16 ),
+					_mm256_mullo_epi16( d16, _mm256_sub_epi16( c255, a16 ) ) );
+			x = _mm256_add_epi16( x, c128 );
+			t[h] = _mm256_srli_epi16( _mm256_add_epi16( x, _mm256_srli_epi16( x, 8 ) ), 8 );
+		}
+		// Packing works per 128 bit lane, put the pixels back in order
+		const __m256i p = _mm256_permute4x64_epi64( _mm256_packus_epi16( t[0], t[1] ), _MM_SHUFFLE( 3, 1, 2, 0 ) );
+		_mm256_storeu_si256( (__m256i*)&dst[4 * i], p );
+	}
+#elif defined( __SSE2__ )
+	const __m128i rgb16 = _mm_setr_epi16( rgb[0], rgb[1], rgb[2], 0, rgb[0], rgb[1], rgb[2], 0 );
+	const __m128i alpha_lane = _mm_setr_epi16( 0, 0, 0, -1, 0, 0, 0, -1 );
+	const __m128i c255 = _mm_set1_epi16( 255 );
+	const __m128i c128 = _mm_set1_epi16( 128 );
+	const __m128i zero = _mm_setzero_si128();
+	for( ; i + 4 <= n; i += 4 ) {
+		int a4;
+		memcpy( &a4, &alpha[i], 4 );
+		if( 0 == a4 )
+			continue;
+		// Each coverage byte to the four channels of its pixel
+		__m128i a = _mm_cvtsi32_si128( a4 );
+		a = _mm_unpacklo_epi8( a, a );
+		a = _mm_unpacklo_epi16( a, a );
+		const __m128i d = _mm_loadu_si128( (const __m128i*)&dst[4 * i] );
+		__m128i t[2];
+		for( int h = 0; h < 2; ++h ) {
+			const __m128i a16 = 0 == h ? _mm_unpacklo_epi8( a, zero ) : _mm_unpackhi_epi8( a, zero );
+			const __m128i d16 = 0 == h ? _mm_unpacklo_epi8( d, zero ) : _mm_unpackhi_epi8( d, zero );
+			const __m128i s16 = _mm_or_si128( rgb16, _mm_and_si128( a16, alpha_lane ) );
+			__m128i x = _mm_add_epi16( _mm_mullo_epi16( s16, a16 ), _mm_mullo_epi16( d16, _mm_sub_epi16( c255, a16 ) ) );
+			x = _mm_add_epi16( x, c128 );
+			t[h] = _mm_srli_epi16( _mm_add_epi16( x, _mm_srli_epi16( x, 8 ) ), 8 );
+		}
+		_mm_storeu_si128( (__m128i*)&dst[4 * i], _mm_packus_epi16( t[0], t[1] ) );
+	}
+#endif
+	for( ; i < n; ++i ) {
+		const unsigned int a = alpha[i];
+		if( 0 == a )
+			continue;
+		unsigned char* p = &dst[4 * i];
+		for( int c = 0; c < 4; ++c ) {
+			const unsigned int x = ( c < 3 ? rgb[c] : a ) * a + p[c] * ( 255 - a ) + 128;
+			p[c] = (unsigned char)( ( x + ( x >> 8 ) ) >> 8 );
+		}
+	}
+}
+
+// Texel of a font's image, 0 outside of it like the padding around the font in the atlas
+static inline float gui_soft_texel( const font_info_t* font, int u, int v ) {
+	const int width = (int)font->atlas_width;
+	return u >= 0 && u < width && v >= 0 && v < (int)font->atlas_height ? (float)font->pixels[v * width + u] : 0.0f;
+}
+
+// Linear filtered texel of a font's image at continuous texel coordinates, like GL_LINEAR in the atlas
+static inline float gui_soft_sample( const font_info_t* font, float u, float v ) {
+	const float fu = u - 0.5f;
+	const float fv = v - 0.5f;
+	const int u0 = (int)floorf( fu );
+	const int v0 = (int)floorf( fv );
+	const float wu = fu - (float)u0;
+	const float wv = fv - (float)v0;
+	const float a = gui_soft_texel( font, u0, v0 );
+	const float b = gui_soft_texel( font, u0 + 1, v0 );
+	const float c = gui_soft_texel( font, u0, v0 + 1 );
+	const float d = gui_soft_texel( font, u0 + 1, v0 + 1 );
+	const float top = a + ( b - a ) * wu;
+	const float bottom = c + ( d - c ) * wu;
+	return top + ( bottom - top ) * wv;
+}
+
+/* Coverage of n pixels from px on row py like glyph_shader_sdf.fs. fwidth() is taken from the
+ * distance of the neighbors in each 2x2 pixel quad as GL does, so ridges in the middle of
+ * strokes stay opaque. The neighbors may lie outside the quad, the sampling extrapolates */
+static void gui_soft_sdf_span( unsigned char* restrict span, const font_info_t* font, float tu, float tv,
+		float x, float y, float su, float sv, int px, int py, int n ) {
+	float row[GUI_SOFT_SPAN + 2];
+	float pair[GUI_SOFT_SPAN + 2];
+	// The quads' columns and the other row of their quad
+	const int qx = px & ~1;
+	const int m = ( ( px + n + 1 ) & ~1 ) - qx;
+	const int qy = py ^ 1;
+	const float v = tv - ( (float)py + 0.5f - y ) * sv;
+	const float vq = tv - ( (float)qy + 0.5f - y ) * sv;
+	for( int i = 0; i < m; ++i ) {
+		const float u = tu + ( (float)( qx + i ) + 0.5f - x ) * su;
+		row[i] = gui_soft_sample( font, u, v ) / 255.0f;
+		pair[i] = gui_soft_sample( font, u, vq ) / 255.0f;
+	}
+	for( int i = px - qx; i < px - qx + n; ++i ) {
+		const float d = row[i];
+		const float width = fabsf( row[i ^ 1] - d ) + fabsf( pair[i] - d );
+		float t = width > 0.0f ? ( d - 0.5f + width ) / ( 2.0f * width ) : ( d >= 0.5f ? 1.0f : 0.0f );
+		t = t < 0.0f ? 0.0f : t > 1.0f ? 1.0f : t;
+		*span++ = (unsigned char)( t * t * ( 3.0f - 2.0f * t ) * 255.0f + 0.5f );
+	}
+}
+
+void gui_soft_draw_glyphs( gui_soft_framebuffer_t* fb, const font_info_t* font,
+		const gui_glyph_t* glyphs, GLsizei count, float origin_x, float origin_y, const vec3f* color,
+		const gui_clip_rect_t* clip ) {
+	const unsigned char rgb[3] = { gui_soft_byte( color->x ), gui_soft_byte( color->y ), gui_soft_byte( color->z ) };
+	// Pixel box like the scissor box of a clip rect
+	int box[4] = { 0, 0, (int)fb->width, (int)fb->height };
+	if( NULL != clip ) {
+		box[0] = (int)floorf( clip->left ) > 0 ? (int)floorf( clip->left ) : 0;
+		box[1] = (int)floorf( clip->bottom ) > 0 ? (int)floorf( clip->bottom ) : 0;
+		box[2] = (int)ceilf( clip->right ) < box[2] ? (int)ceilf( clip->right ) : box[2];
+		box[3] = (int)ceilf( clip->top ) < box[3] ? (int)ceilf( clip->top ) : box[3];
+	}
+	const int stride = (int)font->atlas_width;
+	unsigned char span[GUI_SOFT_SPAN];
+	for( GLsizei k = 0; k < count; ++k ) {
+		const gui_glyph_t* g = &glyphs[k];
+		if( g->rect.z <= 0.0f || g->rect.w <= 0.0f )
+			continue;
+		const float x = origin_x + g->rect.x;
+		const float y = origin_y + g->rect.y;
+		// Pixels whose centers lie in the quad, as GL rasterizes it
+		int x0 = (int)ceilf( x - 0.5f ), x1 = (int)ceilf( x + g->rect.z - 0.5f );
+		int y0 = (int)ceilf( y - 0.5f ), y1 = (int)ceilf( y + g->rect.w - 0.5f );
+		x0 = x0 > box[0] ? x0 : box[0];
+		y0 = y0 > box[1] ? y0 : box[1];
+		x1 = x1 < box[2] ? x1 : box[2];
+		y1 = y1 < box[3] ? y1 : box[3];
+		if( x0 >= x1 || y0 >= y1 )
+			continue;
+		// Left and bottom edge of the glyph in the font's image
+		const float tu = (float)( g->texel_rect[0] - font->atlas_x );
+		const float tv = (float)( g->texel_rect[1] + g->texel_rect[3] - font->atlas_y );
+		// Texels per pixel
+		const float su = (float)g->texel_rect[2] / g->rect.z;
+		const float sv = (float)g->texel_rect[3] / g->rect.w;
+		// Unscaled glyphs at whole pixels hit texel centers, their rows are copied
+		const bool direct = 1.0f == su && 1.0f == sv && x == floorf( x ) && y == floorf( y );
+		for( int py = y0; py < y1; ++py ) {
+			unsigned char* row = &fb->pixels[4 * ( (size_t)py * fb->width )];
+			// Image rows run top down
+			const float v = tv - ( (float)py + 0.5f - y ) * sv;
+			for( int px = x0; px < x1; px += GUI_SOFT_SPAN ) {
+				const int n = x1 - px < GUI_SOFT_SPAN ? x1 - px : GUI_SOFT_SPAN;
+				if( font->sdf_spread > 0 )
+					gui_soft_sdf_span( span, font, tu, tv, x, y, su, sv, px, py, n );
+				else if( direct ) {
+					const int tx = (int)tu + ( px - (int)x );
+					memcpy( span, &font->pixels[(size_t)( (int)floorf( v ) * stride + tx )], (size_t)n );
+				} else
+					for( int i = 0; i < n; ++i ) {
+						const float u = tu + ( (float)( px + i ) + 0.5f - x ) * su;
+						span[i] = (unsigned char)( gui_soft_sample( font, u, v ) + 0.5f );
+					}
+				gui_soft_blend_span( &row[4 * px], span, n, rgb );
+			}
+		}
+	}
+}
+
+void gui_soft_render_window( gui_soft_framebuffer_t* fb, const gui_window_t* w, const vec3f* color ) {
+	const gui_window_internals_t* in = w->internals;
+	const float x = (float)w->upper_left_x;
+	const float y = (float)w->upper_left_y;
+	gui_clip_rect_t clip;
+	if( in->clipped )
+		clip = (gui_clip_rect_t){ x + in->clip.left, y + in->clip.bottom, x + in->clip.right, y + in->clip.top };
+	const gui_clip_rect_t* c = in->clipped ? &clip : NULL;
+	gui_soft_draw_glyphs( fb, w->font, in->static_glyphs, in->num_static_glyphs, x, y, color, c );
+	gui_soft_draw_glyphs( fb, w->font, in->dynamic_glyph_slots, in->dynamic_elements.num_slot_glyphs,
+			x, y, color, c );
+}
+
+bool gui_soft_write_ppm( const gui_soft_framebuffer_t* fb, const char* filename ) {
+	FILE* f = fopen( filename, "wb" );
+	if( NULL == f ) {
+		fprintf( stderr, "Could not open '%s' for writing\n", filename );
+		return false;
+	}
+	bool ok = fprintf( f, "P6\n%u %u\n255\n", fb->width, fb->height ) > 0;
+	unsigned char* line = malloc( (size_t)fb->width * 3 );
+	ok = ok && NULL != line;
+	for( unsigned int r = 0; ok && r < fb->height; ++r ) {
+		const unsigned char* p = &fb->pixels[4 * (size_t)( fb->height - 1 - r ) * fb->width];
+		for( unsigned int i = 0; i < fb->width; ++i )
+			memcpy( &line[3 * i], &p[4 * i], 3 );
+		ok = fwrite( line, 3, fb->width, f ) == fb->width;
+	}
+	free( line );
+	if( 0 != fclose( f ) || !ok ) {
+		fprintf( stderr, "Error writing '%s'\n", filename );
+		return false;
+	}
+	return true;
+}
+
+bool gui_soft_read_ppm( gui_soft_framebuffer_t* fb, const char* filename ) {
+	FILE* f = fopen( filename, "rb" );
+	if( NULL == f ) {
+		fprintf( stderr, "Could not open '%s' for reading\n", filename );
+		return false;
+	}
+	unsigned int width, height, max;
+	// One whitespace character ends the header
+	if( 3 != fscanf( f, "P6 %u %u %u", &width, &height, &max ) || 255 != max || EOF == fgetc( f ) ||
+			0 == width || 0 == height ) {
+		fprintf( stderr, "'%s' is no binary PPM with 8 bit channels\n", filename );
+		fclose( f );
+		return false;
+	}
+	memset( fb, 0, sizeof( gui_soft_framebuffer_t ) );
+	unsigned char* line = malloc( (size_t)width * 3 );
+	bool ok = NULL != line && gui_soft_framebuffer_create( fb, width, height );
+	for( unsigned int r = 0; ok && r < height; ++r ) {
+		ok = fread( line, 3, width, f ) == width;
+		unsigned char* p = &fb->pixels[4 * (size_t)( height - 1 - r ) * width];
+		for( unsigned int i = 0; ok && i < width; ++i ) {
+			memcpy( &p[4 * i], &line[3 * i], 3 );
+			p[4 * i + 3] = 255;
+		}
+	}
+	if( !ok ) {
+		fprintf( stderr, "Error reading '%s'\n", filename );
+		gui_soft_framebuffer_delete( fb );
+	}
+	free( line );
+	fclose( f );
+	return ok;
+}
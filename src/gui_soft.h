@@ -0,0 +1,48 @@
+/*
+ * Software renderer for gui windows, for servers and CI machines without a GPU to draw with.
+ * It composites the glyph instances the GL path draws, as laid out by glyph_screen_coords(),
+ * from the fonts' CPU images into an RGBA8 framebuffer. Blending matches
+ * GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA in 8 bit integers, 8 pixels at once with AVX2 and
+ * 4 with SSE2. Frames can be written to disk.
+ * No GL context is needed: call gl_state_set_available( false ) before creating fonts and
+ * windows, they then make no GL calls. With GL the same windows can be drawn both ways.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "gui_window.h"
+#include "gl_state.h"
+#include "omath/vec3f.h"
+
+typedef struct {
+	unsigned int width;
+	unsigned int height;
+	// RGBA8, rows bottom up like a GL framebuffer
+	unsigned char* pixels;
+} gui_soft_framebuffer_t;
+
+bool gui_soft_framebuffer_create( gui_soft_framebuffer_t* fb, unsigned int width, unsigned int height );
+
+void gui_soft_framebuffer_delete( gui_soft_framebuffer_t* fb );
+
+/* Fills the framebuffer with an opaque color, components 0-1 */
+void gui_soft_clear( gui_soft_framebuffer_t* fb, const vec3f* color );
+
+/* Composites glyph instances of font in color, sampled from the font's CPU image. Their rects are
+ * relative to origin, in pixels from the lower left of the framebuffer, and only pixels inside
+ * clip are touched, if not NULL. The layer is ignored */
+void gui_soft_draw_glyphs( gui_soft_framebuffer_t* fb, const font_info_t* font,
+		const gui_glyph_t* glyphs, GLsizei count, float origin_x, float origin_y, const vec3f* color,
+		const gui_clip_rect_t* clip );
+
+/* Draws a window's static and variable elements like gui_window_render(), including its clip rect.
+ * Call gui_window_update() on it before */
+void gui_soft_render_window( gui_soft_framebuffer_t* fb, const gui_window_t* w, const vec3f* color );
+
+/* Writes the framebuffer as binary PPM, top row first. Alpha is dropped */
+bool gui_soft_write_ppm( const gui_soft_framebuffer_t* fb, const char* filename );
+
+/* Creates a framebuffer from a binary PPM with 8 bit channels as written by gui_soft_write_ppm(),
+ * alpha is opaque. Comments in the header are not supported */
+bool gui_soft_read_ppm( gui_soft_framebuffer_t* fb, const char* filename );
@@ -0,0 +1,194 @@
+#define _POSIX_C_SOURCE 200809L	// clock_gettime() also with -std=c11
+
+#include "gui_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// memset()
+#include <time.h>	// clock_gettime()
+
+static const char* const labels[GUI_STATS_METRICS] = {
+	"update ms", "render ms", "gpu ms", "draws", "glyphs", "kB written"
+};
+static const char* const formats[GUI_STATS_METRICS] = {
+	"%8.3f", "%8.3f", "%8.3f", "%8.1f", "%8.0f", "%8.2f"
+};
+
+// The overlay that measures, NULL if none
+static gui_stats_t* active = NULL;
+// Sums of the current frame
+static double update_seconds = 0.0;
+static double render_seconds = 0.0;
+static unsigned long draws = 0;
+// Glyph instances drawn, the empty ones of free ranges and slots included
+static unsigned long glyphs = 0;
+static size_t bytes = 0;
+
+static double gui_stats_now() {
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+double gui_stats_update_begin() {
+	return NULL != active ? gui_stats_now() : 0.0;
+}
+
+void gui_stats_update_end( double start ) {
+	if( 0.0 != start )
+		update_seconds += gui_stats_now() - start;
+}
+
+double gui_stats_render_begin() {
+	if( NULL == active )
+		return 0.0;
+	gui_stats_query_frame_t* f = &(active->query_frames[active->query_frame]);
+	if( f->count == f->capacity ) {
+		const GLsizei c = f->capacity > 0 ? 2 * f->capacity : 4;
+		GLuint* q = realloc( f->queries, (size_t)c * sizeof( GLuint ) );
+		if( NULL == q ) {
+			fputs( "Out of memory for gui stats queries\n", stderr );
+			return gui_stats_now();
+		}
+		glCreateQueries( GL_TIME_ELAPSED, c - f->capacity, &q[f->capacity] );
+		f->queries = q;
+		f->capacity = c;
+	}
+	glBeginQuery( GL_TIME_ELAPSED, f->queries[f->count] );
+	return gui_stats_now();
+}
+
+void gui_stats_render_end( double start ) {
+	if( 0.0 == start )
+		return;
+	render_seconds += gui_stats_now() - start;
+	gui_stats_query_frame_t* f = &(active->query_frames[active->query_frame]);
+	if( f->count < f->capacity ) {
+		glEndQuery( GL_TIME_ELAPSED );
+		++f->count;
+	}
+}
+
+void gui_stats_count_draw( GLsizei instances ) {
+	++draws;
+	glyphs += (unsigned long)instances;
+}
+
+void gui_stats_count_upload( size_t n ) {
+	bytes += n;
+}
+
+gui_stats_t* gui_stats_create( const font_info_t* font, int upper_left_x, int upper_left_y,
+		float app_window_size_x, float app_window_size_y ) {
+	if( NULL != active ) {
+		fputs( "Only one gui stats overlay at a time\n", stderr );
+		return NULL;
+	}
+	gui_stats_t* s = calloc( 1, sizeof( gui_stats_t ) );
+	if( NULL == s ) {
+		fputs( "Out of memory for gui stats\n", stderr );
+		return NULL;
+	}
+	s->window = gui_window_create( "Gui stats", font, upper_left_x, upper_left_y, app_window_size_x, app_window_size_y );
+	if( NULL == s->window || !gui_window_begin( s->window ) ) {
+		free( s );
+		return NULL;
+	}
+	// Columns for 8 digits of about half the line height
+	const float line = (float)font->height + 1.0f;
+	const float column = 5.0f * line;
+	bool ok = gui_window_add_static_text( s->window, "min", 1.5f * column, line ) &&
+			gui_window_add_static_text( s->window, "avg", 2.5f * column, line ) &&
+			gui_window_add_static_text( s->window, "max", 3.5f * column, line );
+	for( int m = 0; ok && m < GUI_STATS_METRICS; ++m ) {
+		const float y = (float)( m + 2 ) * line;
+		ok = gui_window_add_static_text( s->window, labels[m], 1.0f, y );
+		for( int c = 0; ok && c < 3; ++c )
+			ok = gui_window_add_variable( s->window, gui_float, &(s->shown[m][c]), formats[m],
+					(float)( c + 1 ) * column, y );
+	}
+	if( !ok || !gui_window_end( s->window ) ) {
+		gui_window_delete( s->window );
+		free( s );
+		return NULL;
+	}
+	update_seconds = render_seconds = 0.0;
+	draws = glyphs = 0;
+	bytes = 0;
+	active = s;
+	return s;
+}
+
+static void gui_stats_push( gui_stats_t* s, gui_stats_metric_t m, float value ) {
+	s->history[m][s->history_next[m]] = value;
+	s->history_next[m] = ( s->history_next[m] + 1 ) % GUI_STATS_HISTORY;
+	if( s->history_count[m] < GUI_STATS_HISTORY )
+		++s->history_count[m];
+}
+
+// Reads the GPU time of a frame's queries if the last one is available, or waiting for it
+static bool gui_stats_read_queries( gui_stats_t* s, gui_stats_query_frame_t* f, bool wait ) {
+	if( !wait ) {
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv( f->queries[f->count - 1], GL_QUERY_RESULT_AVAILABLE, &available );
+		if( GL_FALSE == available )
+			return false;
+	}
+	GLuint64 ns = 0;
+	for( GLsizei q = 0; q < f->count; ++q ) {
+		GLuint64 t;
+		glGetQueryObjectui64v( f->queries[q], GL_QUERY_RESULT, &t );
+		ns += t;
+	}
+	gui_stats_push( s, gui_stats_gpu_ms, (float)( (double)ns * 1e-6 ) );
+	f->pending = false;
+	f->count = 0;
+	return true;
+}
+
+void gui_stats_frame( gui_stats_t* s ) {
+	gui_stats_push( s, gui_stats_update_ms, (float)( update_seconds * 1e3 ) );
+	gui_stats_push( s, gui_stats_render_ms, (float)( render_seconds * 1e3 ) );
+	gui_stats_push( s, gui_stats_draws, (float)draws );
+	gui_stats_push( s, gui_stats_glyphs, (float)glyphs );
+	gui_stats_push( s, gui_stats_kilobytes, (float)( (double)bytes / 1024.0 ) );
+	update_seconds = render_seconds = 0.0;
+	draws = glyphs = 0;
+	bytes = 0;
+	// The next frame's queries go to the oldest set, read the pending ones from there on in order.
+	// That set waits if its results are still not available
+	s->query_frames[s->query_frame].pending = s->query_frames[s->query_frame].count > 0;
+	s->query_frame = ( s->query_frame + 1 ) % GUI_STATS_QUERY_FRAMES;
+	for( int k = 0; k < GUI_STATS_QUERY_FRAMES; ++k ) {
+		gui_stats_query_frame_t* f = &(s->query_frames[( s->query_frame + k ) % GUI_STATS_QUERY_FRAMES]);
+		if( f->pending && !gui_stats_read_queries( s, f, 0 == k ) )
+			break;
+	}
+	for( int m = 0; m < GUI_STATS_METRICS; ++m ) {
+		const int n = s->history_count[m];
+		if( 0 == n )
+			continue;
+		float min = s->history[m][0], max = min, sum = 0.0f;
+		for( int i = 0; i < n; ++i ) {
+			const float v = s->history[m][i];
+			min = v < min ? v : min;
+			max = v > max ? v : max;
+			sum += v;
+		}
+		s->shown[m][gui_stats_min] = min;
+		s->shown[m][gui_stats_avg] = sum / (float)n;
+		s->shown[m][gui_stats_max] = max;
+	}
+}
+
+void gui_stats_delete( gui_stats_t* s ) {
+	for( int k = 0; k < GUI_STATS_QUERY_FRAMES; ++k ) {
+		gui_stats_query_frame_t* f = &(s->query_frames[k]);
+		if( f->capacity > 0 )
+			glDeleteQueries( f->capacity, f->queries );
+		free( f->queries );
+	}
+	if( active == s )
+		active = NULL;
+	gui_window_delete( s->window );
+	free( s );
+}
@@ -0,0 +1,71 @@
+/*
+ * Performance overlay: a gui window that shows what the gui itself costs per frame, as minimum,
+ * average and maximum over the last GUI_STATS_HISTORY frames. CPU time in gui_window_update(),
+ * gui_window_render() and gui_render_all(), GPU time of the render functions from GL_TIME_ELAPSED
+ * queries, draw calls, glyph instances drawn and bytes written to GL buffers.
+ * Query results are read once available, a few frames late, so the CPU never waits for them.
+ * The render functions bracket their work in queries, the host must not have a GL_TIME_ELAPSED
+ * query running while the gui draws. Counting is always on, timing only while an overlay exists.
+ * One overlay at a time.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "gui_window.h"
+
+#define GUI_STATS_HISTORY 120
+// Frames whose queries may be pending before reading one waits for the GPU
+#define GUI_STATS_QUERY_FRAMES ( GUI_FRAMES_IN_FLIGHT + 2 )
+
+typedef enum {
+	gui_stats_update_ms,
+	gui_stats_render_ms,
+	gui_stats_gpu_ms,
+	gui_stats_draws,
+	gui_stats_glyphs,
+	gui_stats_kilobytes,
+	GUI_STATS_METRICS
+} gui_stats_metric_t;
+
+enum { gui_stats_min, gui_stats_avg, gui_stats_max };
+
+typedef struct {
+	// Queries begun in a frame, read when the last one is available
+	GLuint* queries;
+	GLsizei count;
+	GLsizei capacity;
+	bool pending;
+} gui_stats_query_frame_t;
+
+typedef struct {
+	// The overlay, draw it like other windows
+	gui_window_t* window;
+	// Minimum, average and maximum of each metric, shown by the window
+	float shown[GUI_STATS_METRICS][3];
+	// Internals. Per metric ring of values, GPU times arrive later than the others
+	float history[GUI_STATS_METRICS][GUI_STATS_HISTORY];
+	int history_count[GUI_STATS_METRICS];
+	int history_next[GUI_STATS_METRICS];
+	gui_stats_query_frame_t query_frames[GUI_STATS_QUERY_FRAMES];
+	int query_frame;
+} gui_stats_t;
+
+/* Creates the overlay window at a screen position, see gui_window_create(). It is ended and drawn
+ * like any other window */
+gui_stats_t* gui_stats_create( const font_info_t* font, int upper_left_x, int upper_left_y,
+		float app_window_size_x, float app_window_size_y );
+
+/* Closes the frame's measurements and updates the values the window shows next.
+ * Call once per frame after all gui drawing, the overlay's included */
+void gui_stats_frame( gui_stats_t* s );
+
+void gui_stats_delete( gui_stats_t* s );
+
+/* Called by the gui. Start times are 0 without an overlay */
+double gui_stats_update_begin();
+void gui_stats_update_end( double start );
+double gui_stats_render_begin();
+void gui_stats_render_end( double start );
+void gui_stats_count_draw( GLsizei instances );
+void gui_stats_count_upload( size_t bytes );
@@ -1,63 +1,432 @@
 #include "gui_window.h"
 #include "shader_program.h"
-#include "omath/vec4f.h"
+#include "font_atlas.h"
+#include "gui_batch.h"
+#include "gl_state.h"
+#include "gui_stats.h"
 #include "omath/mat4f.h"
 #include <stdio.h>
+#include <math.h>	// floorf()
 #include <string.h>	// memset()
+#include <stddef.h>	// offsetof()
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
 
 static GLuint shader_program;
+// Variant for distance field fonts
+static GLuint sdf_shader_program;
+// Windows alive, the last one deletes the shader programs and the frame block
+static int num_windows = 0;
+// Uniform block shared by all gui programs: the projection, then the windows' origins,
+// two per vec4 in std140 layout, then their colors as RGBA8, four per uvec4
+#define GUI_FRAME_ORIGINS_OFFSET 64
+#define GUI_FRAME_COLORS_OFFSET ( GUI_FRAME_ORIGINS_OFFSET + GUI_MAX_WINDOWS * 2 * (GLsizeiptr)sizeof( float ) )
+#define GUI_FRAME_SIZE ( GUI_FRAME_COLORS_OFFSET + GUI_MAX_WINDOWS * (GLsizeiptr)sizeof( GLuint ) )
+static GLuint frame_buffer = 0;
+// Application window size the projection was made for
+static float frame_width = 0.0f;
+static float frame_height = 0.0f;
+// Set while a window has the slot
+static bool slots_used[GUI_MAX_WINDOWS];
+// Where the shader sources are read from, see gui_set_shader_directory()
+#define GUI_MAX_SHADER_PATH 512
+static char shader_directory[GUI_MAX_SHADER_PATH] = "src";
 
-static bool glyph_screen_coords( vec4f* buffer, GLsizei* index, const char* restrict text,
-		const font_info_t* restrict font, float position_x, float position_y );
+// Program that matches the window's font atlas
+GLuint gui_window_program( const gui_window_t* w ) {
+	return w->font->sdf_spread > 0 ? sdf_shader_program : shader_program;
+}
+
+// Reallocates array to capacity elements through the void* tmp. False if out of memory,
+// the array is untouched then
+#define GUI_GROW( array, capacity, tmp ) \
+	( NULL != ( (tmp) = realloc( (array), (size_t)(capacity) * sizeof( *(array) ) ) ) && ( (array) = (tmp), true ) )
+
+// Capacity for n elements, at least doubled
+static inline GLsizei gui_grown_capacity( GLsizei capacity, GLsizei n ) {
+	const GLsizei c = capacity > 0 ? 2 * capacity : 16;
+	return c > n ? c : n;
+}
+
+// Scale from the font's rasterized height to the window's text height
+static inline float gui_window_text_scale( const gui_window_t* w ) {
+	return w->text_height / (float)w->font->height;
+}
+
+// False if a line of text starting at the pen position can not reach into the window's clip
+// rect. Ascenders and descenders stay within the text height
+static inline bool gui_window_line_visible( const gui_window_t* w, float x, float y ) {
+	const gui_clip_rect_t* c = &(w->internals->clip);
+	return !w->internals->clipped || ( x < c->right && y - w->text_height < c->top && y + w->text_height > c->bottom );
+}
+
+// Clip rect for glyph_screen_coords()
+static inline const gui_clip_rect_t* gui_window_glyph_clip( const gui_window_t* w ) {
+	return w->internals->clipped ? &(w->internals->clip) : NULL;
+}
+
+// Marks glyphs with the window's slot, the vertex shader adds the window's origin with it
+static inline void gui_window_tag_glyphs( const gui_window_t* w, gui_glyph_t* glyphs, GLsizei count ) {
+	const GLuint tag = w->internals->slot << 16;
+	for( GLsizei i = 0; i < count; ++i )
+		glyphs[i].layer |= tag;
+}
+
+// False if the rect lies entirely outside of the clip rect
+static inline bool gui_clip_overlaps( const gui_clip_rect_t* c, float x, float y, float width, float height ) {
+	return x < c->right && x + width > c->left && y < c->top && y + height > c->bottom;
+}
+
+bool gui_set_shader_directory( const char* directory ) {
+	if( strlen( directory ) >= GUI_MAX_SHADER_PATH ) {
+		fprintf( stderr, "Shader directory '%s' is too long\n", directory );
+		return false;
+	}
+	strcpy( shader_directory, directory );
+	return true;
+}
+
+// Creates the program for the font's kind of atlas unless it exists. False if it can not be created
+static bool gui_window_create_program( const font_info_t* font ) {
+	GLuint* program = font->sdf_spread > 0 ? &sdf_shader_program : &shader_program;
+	if( glIsProgram( *program ) )
+		return true;
+	// Room for the longest file name
+	char vertex_file[GUI_MAX_SHADER_PATH + sizeof( "/glyph_shader_sdf.fs" )];
+	char fragment_file[GUI_MAX_SHADER_PATH + sizeof( "/glyph_shader_sdf.fs" )];
+	snprintf( vertex_file, sizeof( vertex_file ), "%s/glyph_shader.vs", shader_directory );
+	snprintf( fragment_file, sizeof( fragment_file ), "%s/%s", shader_directory,
+			font->sdf_spread > 0 ? "glyph_shader_sdf.fs" : "glyph_shader.fs" );
+	if( shader_program_create( program, vertex_file, fragment_file ) )
+		return true;
+	*program = 0;
+	fprintf( stderr, "No gui shader program, are the shaders in '%s'?\n", shader_directory );
+	return false;
+}
 
 gui_window_t* gui_window_create( const char* title, const font_info_t* font,
 		int upper_left_x, int upper_left_y, float app_window_size_x, float app_window_size_y ) {
 	// @todo: validity checks
+	GLuint slot = 0;
+	while( slot < GUI_MAX_WINDOWS && slots_used[slot] )
+		++slot;
+	if( GUI_MAX_WINDOWS == slot ) {
+		fprintf( stderr, "Maximum of %d gui windows reached\n", GUI_MAX_WINDOWS );
+		return NULL;
+	}
+	// Without GL the window is only drawn by the software renderer and needs no program
+	if( gl_state_available() && !gui_window_create_program( font ) )
+		return NULL;
 	gui_window_t* w = malloc( sizeof( gui_window_t ) );
-	// Create shader only once
 	if( NULL != w ) {
 		w->internals = malloc( sizeof( gui_window_internals_t ) );
 		if( NULL == w->internals ) {
 			free( w );
 			w = NULL;
 		} else {
-			if( !glIsProgram( shader_program ) )
-				shader_program_create( &shader_program, "src/glyph_shader.vs", "src/glyph_shader.fs" );
+			// Stays 0 without GL
+			if( 0 == frame_buffer && gl_state_available() ) {
+				glCreateBuffers( 1, &frame_buffer );
+				glNamedBufferStorage( frame_buffer, GUI_FRAME_SIZE, NULL, GL_DYNAMIC_STORAGE_BIT );
+			}
+			slots_used[slot] = true;
+			w->internals->slot = slot;
 			strncpy( w->title, title, MAX_GUI_ELEMENT_LENGTH );
 			w->font = font;
 			w->upper_left_x = upper_left_x;
 			w->upper_left_y = upper_left_y;
 			w->app_window_size_x = app_window_size_x;
 			w->app_window_size_y = app_window_size_y;
+			w->text_height = (float)font->height;
+			gui_window_move( w, upper_left_x, upper_left_y );
+			// White until set, the slot may still hold the color of a deleted window
+			w->internals->color = 0xffffffffu;
+			if( 0 != frame_buffer ) {
+				glNamedBufferSubData( frame_buffer, GUI_FRAME_COLORS_OFFSET + (GLintptr)slot * (GLintptr)sizeof( GLuint ),
+						sizeof( GLuint ), &(w->internals->color) );
+				gui_stats_count_upload( sizeof( GLuint ) );
+			}
+			++num_windows;
 		}
 	}
 	return w;
 }
 
-bool gui_window_begin( const gui_window_t* w ) {
-	// @todo: projection matrix must be renewed when app. window size changes
+void gui_window_move( gui_window_t* w, int upper_left_x, int upper_left_y ) {
+	w->upper_left_x = upper_left_x;
+	w->upper_left_y = upper_left_y;
+	if( 0 == frame_buffer )
+		return;
+	const float origin[2] = { (float)upper_left_x, (float)upper_left_y };
+	glNamedBufferSubData( frame_buffer, GUI_FRAME_ORIGINS_OFFSET + (GLintptr)w->internals->slot * (GLintptr)sizeof( origin ),
+			sizeof( origin ), origin );
+	gui_stats_count_upload( sizeof( origin ) );
+}
+
+// Color channel in [0-1] as byte
+static inline GLuint gui_color_byte( float c ) {
+	return (GLuint)( ( c < 0.0f ? 0.0f : c > 1.0f ? 1.0f : c ) * 255.0f + 0.5f );
+}
+
+void gui_window_set_color( gui_window_t* w, const vec3f* color ) {
+	const GLuint rgba = gui_color_byte( color->x ) | gui_color_byte( color->y ) << 8 |
+			gui_color_byte( color->z ) << 16 | 0xff000000u;
+	if( rgba == w->internals->color )
+		return;
+	w->internals->color = rgba;
+	if( 0 == frame_buffer )
+		return;
+	glNamedBufferSubData( frame_buffer, GUI_FRAME_COLORS_OFFSET + (GLintptr)w->internals->slot * (GLintptr)sizeof( GLuint ),
+			sizeof( GLuint ), &rgba );
+	gui_stats_count_upload( sizeof( rgba ) );
+}
+
+void gui_resize( float width, float height ) {
+	if( 0 == frame_buffer || ( width == frame_width && height == frame_height ) )
+		return;
 	mat4f projection;
-	mat4f_ortho( &projection, 0.0f, w->app_window_size_x, 0.0f, w->app_window_size_y, 0.0f, 1.0f );
-	glUseProgram( shader_program );
-	glUniformMatrix4fv( glGetUniformLocation( shader_program, "projection"), 1, GL_FALSE, &projection.data[0] );
+	mat4f_ortho( &projection, 0.0f, width, 0.0f, height, 0.0f, 1.0f );
+	glNamedBufferSubData( frame_buffer, 0, sizeof( projection.data ), &projection.data[0] );
+	gui_stats_count_upload( sizeof( projection.data ) );
+	frame_width = width;
+	frame_height = height;
+}
+
+void gui_frame_bind() {
+	gl_state_bind_uniform_buffer( GUI_FRAME_BINDING, frame_buffer );
+}
+
+bool gui_window_begin( const gui_window_t* w ) {
+	gui_resize( w->app_window_size_x, w->app_window_size_y );
 
 	gui_window_internals_t* i = w->internals;
-	// Configure vertex array and buffers
-	glCreateVertexArrays( 1, &(i->vertex_array) );
-	// Only one vec4f attrib: .xy = coords, .zw = texture coords from font atlas
-	glVertexArrayAttribFormat( i->vertex_array, 0, 4, GL_FLOAT, GL_FALSE, 0 );
-	glEnableVertexArrayAttrib( i->vertex_array, 0 );
-	glCreateBuffers( 1, &(i->static_vertex_buffer) );
-	glCreateBuffers( 1, &(i->dynamic_vertex_buffer) );
-
-	// Set counters and init element arrays
-	i->num_static_elements = 0;
-	i->num_static_vertices = 0;
-	i->num_dynamic_elements = 0;
-	i->num_dynamic_vertices = 0;
-	memset( &(i->static_elements[0]), 0, sizeof( i->static_elements ) );
-	memset( &(i->dynamic_elements[0]), 0, sizeof( i->dynamic_elements ) );
+	// Configure vertex array and buffers, without GL only the CPU copies of the glyphs are kept
+	i->vertex_array = i->static_glyph_buffer = 0;
+	if( gl_state_available() ) {
+		gui_glyph_vertex_array_create( &(i->vertex_array) );
+		glCreateBuffers( 1, &(i->static_glyph_buffer) );
+	}
+
+	// Set counters and init element arrays, they grow when elements are added
+	i->num_static_glyphs = 0;
+	i->static_glyph_capacity = 0;
+	i->static_glyphs = NULL;
+	i->free_static_ranges = NULL;
+	i->num_free_static_ranges = 0;
+	i->free_static_ranges_capacity = 0;
+	i->static_dirty_first = i->static_dirty_end = 0;
+	i->ended = false;
+	i->clip_x = i->clip_y = i->clip_width = i->clip_height = 0.0f;
+	i->clipped = false;
+	i->relayout_dynamic = false;
+	i->num_dynamic_glyphs = 0;
+	memset( &(i->static_elements), 0, sizeof( i->static_elements ) );
+	memset( &(i->dynamic_elements), 0, sizeof( i->dynamic_elements ) );
+	memset( &(i->region_generations[0]), 0, sizeof( i->region_generations ) );
+	memset( &(i->region_num_glyphs[0]), 0, sizeof( i->region_num_glyphs ) );
+	memset( &(i->dynamic_glyphs), 0, sizeof( i->dynamic_glyphs ) );
+	i->dynamic_glyph_slots = NULL;
+	i->dynamic_generation = 0;
+	i->uploaded_generation = 0;
+
+	return true;
+}
 
+// Stores text as the element's text, over the old one if it fits its room, else at the end of
+// the pool. A pool that has to grow is rebuilt with the other live texts only, so replaced
+// and removed texts do not pile up
+static bool gui_window_pool_text( gui_static_elements_t* e, GLsizei element, const char* text ) {
+	const size_t len = strlen( text );
+	if( len <= e->text_capacities[element] ) {
+		memcpy( &(e->text_pool[e->text_offsets[element]]), text, len + 1 );
+		return true;
+	}
+	const size_t old = e->text_capacities[element] > 0 ? e->text_capacities[element] + 1 : 0;
+	if( e->text_pool_size + len + 1 > e->text_pool_capacity ) {
+		const size_t c = 2 * ( e->text_pool_used - old + len + 1 );
+		char* pool = malloc( c );
+		if( NULL == pool ) {
+			fputs( "Out of memory for gui element texts\n", stderr );
+			return false;
+		}
+		size_t size = 0;
+		for( GLsizei i = 0; i < e->count; ++i ) {
+			if( i == element || 0 == e->text_capacities[i] )
+				continue;
+			const char* t = &(e->text_pool[e->text_offsets[i]]);
+			memcpy( &pool[size], t, strlen( t ) + 1 );
+			e->text_offsets[i] = size;
+			size += e->text_capacities[i] + 1;
+		}
+		free( e->text_pool );
+		e->text_pool = pool;
+		e->text_pool_size = e->text_pool_used = size;
+		e->text_pool_capacity = c;
+	} else
+		e->text_pool_used -= old;
+	memcpy( &(e->text_pool[e->text_pool_size]), text, len + 1 );
+	e->text_offsets[element] = e->text_pool_size;
+	e->text_capacities[element] = len;
+	e->text_pool_size += len + 1;
+	e->text_pool_used += len + 1;
+	return true;
+}
+
+// Takes or drops pins of the text's glyphs in the font's cache. Static text is laid out again
+// only when it changes, its glyphs must not be evicted meanwhile. False if a pin could not be
+// taken, the ones taken before are dropped again so the text holds no pins then
+static bool gui_window_pin_text( const gui_window_t* w, const char* text, bool pin ) {
+	const char* t = text;
+	for( unsigned int c = font_utf8_next( &t ); 0 != c; c = font_utf8_next( &t ) ) {
+		if( c < 128 )
+			continue;
+		if( !pin )
+			font_unpin_glyph( w->font, c );
+		else if( !font_pin_glyph( w->font, c ) ) {
+			// No pin was taken for this glyph, only the ones before it are dropped
+			const char* end = t;
+			t = text;
+			for( unsigned int d = font_utf8_next( &t ); t < end && 0 != d; d = font_utf8_next( &t ) )
+				if( d >= 128 )
+					font_unpin_glyph( w->font, d );
+			fprintf( stderr, "Could not pin glyph U+%04X of gui text\n", c );
+			return false;
+		}
+	}
+	return true;
+}
+
+// Same for the literals of a variable's format
+static bool gui_window_pin_literals( const gui_window_t* w, const gui_format_t* f, bool pin ) {
+	char literals[GUI_FORMAT_MAX_LITERALS + 1];
+	memcpy( literals, f->literals, (size_t)( f->prefix_length + f->suffix_length ) );
+	literals[f->prefix_length + f->suffix_length] = '\0';
+	return gui_window_pin_text( w, literals, pin );
+}
+
+// Extends the range of static instances gui_render_all() has to copy again
+static inline void gui_window_static_dirty( gui_window_internals_t* in, GLsizei first, GLsizei count ) {
+	if( in->static_dirty_first >= in->static_dirty_end ) {
+		in->static_dirty_first = first;
+		in->static_dirty_end = first + count;
+		return;
+	}
+	if( first < in->static_dirty_first )
+		in->static_dirty_first = first;
+	if( first + count > in->static_dirty_end )
+		in->static_dirty_end = first + count;
+}
+
+// Empties a range of the static buffer and keeps it for reuse, merged with adjacent free ones
+static void gui_window_free_static_range( gui_window_internals_t* in, GLsizei first, GLsizei count ) {
+	if( 0 == count )
+		return;
+	if( 0 != in->static_glyph_buffer )
+		glClearNamedBufferSubData( in->static_glyph_buffer, GL_R32UI, (GLintptr)first * (GLintptr)sizeof( gui_glyph_t ),
+				(GLsizeiptr)count * (GLsizeiptr)sizeof( gui_glyph_t ), GL_RED_INTEGER, GL_UNSIGNED_INT, NULL );
+	memset( &(in->static_glyphs[first]), 0, (size_t)count * sizeof( gui_glyph_t ) );
+	gui_window_static_dirty( in, first, count );
+	// Free ranges never touch, so this merges with at most one on each side
+	for( GLsizei r = 0; r < in->num_free_static_ranges; ) {
+		const gui_glyph_range_t f = in->free_static_ranges[r];
+		if( f.first + f.count == first || first + count == f.first ) {
+			first = f.first < first ? f.first : first;
+			count += f.count;
+			in->free_static_ranges[r] = in->free_static_ranges[--in->num_free_static_ranges];
+		} else
+			++r;
+	}
+	if( in->num_free_static_ranges == in->free_static_ranges_capacity ) {
+		const GLsizei c = gui_grown_capacity( in->free_static_ranges_capacity, in->num_free_static_ranges + 1 );
+		void* p;
+		if( !GUI_GROW( in->free_static_ranges, c, p ) ) {
+			// The range stays empty and is drawn, but never reused
+			fputs( "Out of memory for free gui glyph ranges\n", stderr );
+			return;
+		}
+		in->free_static_ranges_capacity = c;
+	}
+	in->free_static_ranges[in->num_free_static_ranges++] = (gui_glyph_range_t){ first, count };
+}
+
+// First instance of an empty range of count glyphs. Takes the first free range that fits,
+// else appends to the drawn ones and grows the static buffer if needed. -1 if out of memory
+static GLsizei gui_window_alloc_static_range( gui_window_internals_t* in, GLsizei count ) {
+	for( GLsizei r = 0; r < in->num_free_static_ranges; ++r ) {
+		gui_glyph_range_t* f = &(in->free_static_ranges[r]);
+		if( f->count < count )
+			continue;
+		const GLsizei first = f->first;
+		f->first += count;
+		f->count -= count;
+		if( 0 == f->count )
+			*f = in->free_static_ranges[--in->num_free_static_ranges];
+		return first;
+	}
+	if( in->num_static_glyphs + count > in->static_glyph_capacity ) {
+		// A new buffer of twice the size, the glyphs are copied on the GPU
+		const GLsizei c = gui_grown_capacity( in->static_glyph_capacity, in->num_static_glyphs + count );
+		void* p;
+		if( !GUI_GROW( in->static_glyphs, c, p ) ) {
+			fputs( "Out of memory for gui static glyphs\n", stderr );
+			return -1;
+		}
+		memset( &(in->static_glyphs[in->static_glyph_capacity]), 0,
+				(size_t)( c - in->static_glyph_capacity ) * sizeof( gui_glyph_t ) );
+		if( 0 != in->static_glyph_buffer ) {
+			GLuint b;
+			glCreateBuffers( 1, &b );
+			glNamedBufferData( b, (GLsizeiptr)c * (GLsizeiptr)sizeof( gui_glyph_t ), NULL, GL_DYNAMIC_DRAW );
+			glClearNamedBufferData( b, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL );
+			if( in->num_static_glyphs > 0 )
+				glCopyNamedBufferSubData( in->static_glyph_buffer, b, 0, 0,
+						(GLsizeiptr)in->num_static_glyphs * (GLsizeiptr)sizeof( gui_glyph_t ) );
+			glDeleteBuffers( 1, &(in->static_glyph_buffer) );
+			in->static_glyph_buffer = b;
+		}
+		in->static_glyph_capacity = c;
+	}
+	const GLsizei first = in->num_static_glyphs;
+	in->num_static_glyphs += count;
+	return first;
+}
+
+// Lays out a static element of an ended window into its range and uploads that range.
+// The element moves to another range if its text outgrew it
+static bool gui_window_layout_static_text( gui_window_t* w, GLsizei i ) {
+	gui_window_internals_t* in = w->internals;
+	gui_static_elements_t* e = &(in->static_elements);
+	const char* text = &(e->text_pool[e->text_offsets[i]]);
+	// At most one glyph per byte
+	const GLsizei len = (GLsizei)strlen( text );
+	if( len > e->glyph_capacity[i] ) {
+		const GLsizei first = gui_window_alloc_static_range( in, len );
+		if( first < 0 )
+			return false;
+		gui_window_free_static_range( in, e->glyph_first[i], e->glyph_capacity[i] );
+		e->glyph_first[i] = first;
+		e->glyph_capacity[i] = len;
+		e->glyph_count[i] = 0;
+	}
+	// Laid out in the CPU copy, zeroed so the glyphs a longer text left are emptied
+	gui_glyph_t* buf = &(in->static_glyphs[e->glyph_first[i]]);
+	memset( buf, 0, (size_t)e->glyph_capacity[i] * sizeof( gui_glyph_t ) );
+	GLsizei idx = 0;
+	// OpenGL has 0/0 in the lower left corner. The glyphs were pinned with the text
+	const float x = e->pos_x[i];
+	const float y = -e->pos_y[i];
+	if( gui_window_line_visible( w, x, y ) )
+		glyph_screen_coords( buf, &idx, text, w->font, x, y, gui_window_text_scale( w ), false, gui_window_glyph_clip( w ) );
+	gui_window_tag_glyphs( w, buf, idx );
+	const GLsizei n = idx > e->glyph_count[i] ? idx : e->glyph_count[i];
+	if( n > 0 && 0 != in->static_glyph_buffer ) {
+		glNamedBufferSubData( in->static_glyph_buffer, (GLintptr)e->glyph_first[i] * (GLintptr)sizeof( gui_glyph_t ),
+				(GLsizeiptr)n * (GLsizeiptr)sizeof( gui_glyph_t ), buf );
+		gui_stats_count_upload( (size_t)n * sizeof( gui_glyph_t ) );
+		gui_window_static_dirty( in, e->glyph_first[i], n );
+	}
+	e->glyph_count[i] = idx;
 	return true;
 }
 
@@ -65,157 +434,507 @@ bool gui_window_begin( const gui_window_t* w ) {
  * Renders the 0-terminated string with the gui window's font inside of it
  * at the given position. Gui window position in pixels from upper left */
 bool gui_window_add_static_text( gui_window_t* w, const char* text, const float pos_x, const float pos_y ) {
-	const size_t len = strlen( text );
-	if( 0 == len || MAX_GUI_ELEMENT_LENGTH-1 <= len || NULL == text ) {
-		fputs( "Gui window element text empty or too long\n", stderr );
+	if( NULL == text || '\0' == text[0] ) {
+		fputs( "Gui window element text empty\n", stderr );
 		return false;
 	}
-	gui_window_internals_t* i = w->internals;
-	if( MAX_GUI_ELEMENTS_PER_WINDOW <= i->num_static_elements ) {
-		fputs( "Maximum number of gui elements per window reached\n", stderr );
+	gui_static_elements_t* e = &(w->internals->static_elements);
+	// Removed numbers are taken again before the arrays grow
+	GLsizei n = 0;
+	while( n < e->count && !e->removed[n] )
+		++n;
+	if( n == e->capacity ) {
+		const GLsizei c = gui_grown_capacity( e->capacity, e->count + 1 );
+		void* p;
+		if( !( GUI_GROW( e->pos_x, c, p ) && GUI_GROW( e->pos_y, c, p ) && GUI_GROW( e->text_offsets, c, p ) &&
+				GUI_GROW( e->text_capacities, c, p ) && GUI_GROW( e->glyph_first, c, p ) && GUI_GROW( e->glyph_count, c, p ) &&
+				GUI_GROW( e->glyph_capacity, c, p ) && GUI_GROW( e->removed, c, p ) ) ) {
+			fputs( "Out of memory for gui elements\n", stderr );
+			return false;
+		}
+		e->capacity = c;
+	}
+	if( n == e->count ) {
+		// Not in the pool, a failure below leaves it removed
+		e->text_capacities[n] = 0;
+		e->removed[n] = true;
+		++e->count;
+	}
+	if( !gui_window_pin_text( w, text, true ) )
+		return false;
+	if( !gui_window_pool_text( e, n, text ) ) {
+		gui_window_pin_text( w, text, false );
+		return false;
+	}
+	e->pos_x[n] = pos_x;
+	e->pos_y[n] = pos_y;
+	// Ranges are assigned in gui_window_end(), or on layout after it
+	e->glyph_first[n] = 0;
+	e->glyph_count[n] = 0;
+	e->glyph_capacity[n] = 0;
+	e->removed[n] = false;
+	e->last_added = n;
+	return !w->internals->ended || gui_window_layout_static_text( w, n );
+}
+
+bool gui_window_replace_static_text( gui_window_t* w, GLsizei element, const char* text ) {
+	gui_static_elements_t* e = &(w->internals->static_elements);
+	if( element < 0 || element >= e->count || e->removed[element] ) {
+		fprintf( stderr, "Gui window has no static element %d\n", element );
+		return false;
+	}
+	if( NULL == text || '\0' == text[0] ) {
+		fputs( "Gui window element text empty\n", stderr );
+		return false;
+	}
+	const char* old = &(e->text_pool[e->text_offsets[element]]);
+	if( 0 == strcmp( old, text ) )
+		return true;
+	// The new glyphs are pinned before the old ones are dropped, shared ones stay cached
+	if( !gui_window_pin_text( w, text, true ) )
+		return false;
+	gui_window_pin_text( w, old, false );
+	if( !gui_window_pool_text( e, element, text ) ) {
+		// The old text is unchanged, its glyphs are still cached and are pinned again
+		gui_window_pin_text( w, &(e->text_pool[e->text_offsets[element]]), true );
+		gui_window_pin_text( w, text, false );
+		return false;
+	}
+	return !w->internals->ended || gui_window_layout_static_text( w, element );
+}
+
+bool gui_window_remove_static_text( gui_window_t* w, GLsizei element ) {
+	gui_window_internals_t* in = w->internals;
+	gui_static_elements_t* e = &(in->static_elements);
+	if( element < 0 || element >= e->count || e->removed[element] ) {
+		fprintf( stderr, "Gui window has no static element %d\n", element );
 		return false;
 	}
-	i->static_elements[i->num_static_elements].pos_x = pos_x;
-	i->static_elements[i->num_static_elements].pos_y = pos_y;
-	strncpy( &(i->static_elements[i->num_static_elements].text[0]), text, len );
-	++i->num_static_elements;
-	i->num_static_vertices += (GLsizei)( 6 * len );
+	if( in->ended )
+		gui_window_free_static_range( in, e->glyph_first[element], e->glyph_capacity[element] );
+	gui_window_pin_text( w, &(e->text_pool[e->text_offsets[element]]), false );
+	// The text's bytes are dropped when the pool is rebuilt
+	e->text_pool_used -= e->text_capacities[element] + 1;
+	e->text_capacities[element] = 0;
+	e->removed[element] = true;
+	e->glyph_count[element] = 0;
+	e->glyph_capacity[element] = 0;
 	return true;
 }
 
 bool gui_window_add_variable( gui_window_t* w, const gui_variable_datatype_t data_type,
-		void* variable_name, const float pos_x, const float pos_y ) {
-	gui_window_internals_t* i = w->internals;
-	if( MAX_GUI_ELEMENTS_PER_WINDOW <= i->num_dynamic_elements ) {
-		fputs( "Maximum number of gui elements per window reached\n", stderr );
+		void* variable_name, const char* format, const float pos_x, const float pos_y ) {
+	if( gui_float != data_type && gui_int != data_type ) {
+		fputs( "Datatype of gui variable not supported\n", stderr );
 		return false;
 	}
-	// nothing to memcpy in this struct
-	i->dynamic_elements[i->num_dynamic_elements].datatype = data_type;
-	i->dynamic_elements[i->num_dynamic_elements].variable = variable_name;
-	i->dynamic_elements[i->num_dynamic_elements].pos_x = pos_x;
-	i->dynamic_elements[i->num_dynamic_elements].pos_y = pos_y;
-	++i->num_dynamic_elements;
+	gui_format_t f;
+	if( NULL == format )
+		format = gui_float == data_type ? "%7.2f" : "%9d";
+	if( !gui_format_compile( &f, format ) )
+		return false;
+	if( gui_format_is_float( &f ) != ( gui_float == data_type ) ) {
+		fprintf( stderr, "Gui format '%s' does not match the variable's datatype\n", format );
+		return false;
+	}
+	gui_dynamic_elements_t* e = &(w->internals->dynamic_elements);
+	if( e->count == e->capacity ) {
+		const GLsizei c = gui_grown_capacity( e->capacity, e->count + 1 );
+		void* p;
+		if( !( GUI_GROW( e->pos_x, c, p ) && GUI_GROW( e->pos_y, c, p ) && GUI_GROW( e->datatypes, c, p ) &&
+				GUI_GROW( e->variables, c, p ) && GUI_GROW( e->formats, c, p ) && GUI_GROW( e->shown, c, p ) &&
+				GUI_GROW( e->generations, c, p ) && GUI_GROW( e->num_glyphs, c, p ) &&
+				GUI_GROW( e->slot_first, c, p ) && GUI_GROW( e->slot_size, c, p ) ) ) {
+			fputs( "Out of memory for gui elements\n", stderr );
+			return false;
+		}
+		e->capacity = c;
+	}
+	// Literals outside of ASCII come from the font's glyph cache. The slot is laid out again only
+	// when the value changes, so they are pinned here until the window is deleted
+	if( !gui_window_pin_literals( w, &f, true ) )
+		return false;
+	const GLsizei n = e->count++;
+	e->pos_x[n] = pos_x;
+	e->pos_y[n] = pos_y;
+	e->datatypes[n] = data_type;
+	e->variables[n] = variable_name;
+	e->formats[n] = f;
+	memset( &(e->shown[n]), 0, sizeof( gui_variable_value_t ) );
+	e->generations[n] = 0;
+	e->num_glyphs[n] = 0;
+	e->slot_first[n] = e->num_slot_glyphs;
+	e->slot_size[n] = (GLsizei)gui_format_max_length( &f );
+	e->num_slot_glyphs += e->slot_size[n];
 	return true;
 }
 
-// update the buffer data of variable elements;
+// update the glyphs of variable elements that changed;
 bool gui_window_update( gui_window_t* w ) {
+	const double start = gui_stats_update_begin();
 	gui_window_internals_t* in = w->internals;
-	in->num_dynamic_vertices = 0;
-	vec4f* buf = glMapNamedBuffer( in->dynamic_vertex_buffer, GL_WRITE_ONLY );
-	if( NULL == buf ) {
-		fputs( "Error mapping buffer for dynamic gui data\n", stderr );
-		return false;
-	}
+	gui_dynamic_elements_t* e = &(in->dynamic_elements);
 	// temporary buffer for an element string
-	GLsizei idx = 0;
-	char to_display[MAX_GUI_ELEMENT_LENGTH];
-	for( int i = 0; i < in->num_dynamic_elements; ++i ) {
-		const gui_element_variable_t* e = &(in->dynamic_elements[i]);
-		switch( e->datatype ) {
-			case gui_float:
-				snprintf( &to_display[0], MAX_GUI_ELEMENT_LENGTH, "%7.2f", *(float*)e->variable );
-				break;
-			case gui_int:
-				snprintf( &to_display[0], MAX_GUI_ELEMENT_LENGTH, "%9d", *(int*)e->variable );
-				break;
-			default:
-				fputs( "Unknown datatype in gui variable\n", stderr );
+	char to_display[GUI_FORMAT_MAX_LENGTH + 1];
+	bool changed = false;
+	for( GLsizei i = 0; i < e->count; ++i ) {
+		gui_variable_value_t value;
+		memset( &value, 0, sizeof( value ) );
+		if( gui_float == e->datatypes[i] )
+			value.f = *(float*)e->variables[i];
+		else
+			value.i = *(int*)e->variables[i];
+		// Bitwise, a NaN stays unchanged
+		if( !in->relayout_dynamic && e->generations[i] > 0 && 0 == memcmp( &value, &e->shown[i], sizeof( value ) ) )
+			continue;
+		gui_glyph_t* slot = &in->dynamic_glyph_slots[e->slot_first[i]];
+		GLsizei idx = 0;
+		const float x = e->pos_x[i];
+		const float y = -e->pos_y[i];
+		// Culled elements are not formatted
+		if( gui_window_line_visible( w, x, y ) ) {
+			if( gui_float == e->datatypes[i] )
+				gui_format_float( &e->formats[i], value.f, &to_display[0], sizeof( to_display ) );
+			else
+				gui_format_int( &e->formats[i], value.i, &to_display[0], sizeof( to_display ) );
+			// Digits and signs are ASCII, other glyphs of the format were pinned when it was added
+			glyph_screen_coords( slot, &idx, to_display, w->font, x, y, gui_window_text_scale( w ), false,
+					gui_window_glyph_clip( w ) );
+			gui_window_tag_glyphs( w, slot, idx );
 		}
-		glyph_screen_coords( buf, &idx, to_display, w->font,
-				(float)w->upper_left_x + e->pos_x, (float)w->upper_left_y - e->pos_y );
-		in->num_dynamic_vertices += idx;
+		// Empty the glyphs left over from a longer text
+		if( idx < e->num_glyphs[i] )
+			memset( &slot[idx], 0, (size_t)( e->num_glyphs[i] - idx ) * sizeof( gui_glyph_t ) );
+		in->num_dynamic_glyphs += idx - e->num_glyphs[i];
+		e->num_glyphs[i] = idx;
+		e->shown[i] = value;
+		++e->generations[i];
+		changed = true;
+	}
+	in->relayout_dynamic = false;
+	if( changed )
+		++in->dynamic_generation;
+	gui_stats_update_end( start );
+	return true;
+}
+
+// Copies the slots changed since the last upload to the next ring region
+static bool gui_window_upload( gui_window_internals_t* in ) {
+	// The ring is made on the first upload, windows drawn with gui_render_all() never need one.
+	// Its regions start empty like the slots
+	if( 0 == in->dynamic_glyphs.buffer ) {
+		if( !vertex_ring_create( &in->dynamic_glyphs,
+				(GLsizeiptr)in->dynamic_elements.num_slot_glyphs * (GLsizeiptr)sizeof( gui_glyph_t ), GUI_FRAMES_IN_FLIGHT ) )
+			return false;
+		memset( in->dynamic_glyphs.mapping, 0, (size_t)( in->dynamic_glyphs.region_size * GUI_FRAMES_IN_FLIGHT ) );
+	}
+	// Else the current region is drawn again
+	if( in->uploaded_generation == in->dynamic_generation )
+		return true;
+	// Persistently mapped, never stalls unless the GPU is GUI_FRAMES_IN_FLIGHT frames behind
+	gui_glyph_t* buf = vertex_ring_begin( &in->dynamic_glyphs );
+	if( NULL == buf )
+		return false;
+	const gui_dynamic_elements_t* e = &(in->dynamic_elements);
+	unsigned int* generations = in->region_generations[in->dynamic_glyphs.region];
+	GLsizei* counts = in->region_num_glyphs[in->dynamic_glyphs.region];
+	for( GLsizei i = 0; i < e->count; ++i ) {
+		if( generations[i] == e->generations[i] )
+			continue;
+		// Also overwrites what the region got for a longer text
+		const GLsizei n = e->num_glyphs[i] > counts[i] ? e->num_glyphs[i] : counts[i];
+		memcpy( &buf[e->slot_first[i]], &in->dynamic_glyph_slots[e->slot_first[i]], (size_t)n * sizeof( gui_glyph_t ) );
+		gui_stats_count_upload( (size_t)n * sizeof( gui_glyph_t ) );
+		generations[i] = e->generations[i];
+		counts[i] = e->num_glyphs[i];
 	}
-	if( GL_TRUE != glUnmapNamedBuffer( in->dynamic_vertex_buffer ) )
-		fputs( "Error unmapping gui dynamic buffer. Data corruption ?\n", stderr );
+	in->uploaded_generation = in->dynamic_generation;
 	return true;
 }
 
 bool gui_window_end( gui_window_t* w ) {
 	gui_window_internals_t* in = w->internals;
-	// calculate screen positions and texture coordinates for all window elements
-	// x, y, s, t - screen position x/y, texture atlas position s/t
-	const size_t buffer_size = (size_t)in->num_static_vertices * sizeof( vec4f );
-	// temporary buffer
-	vec4f* buf = malloc( buffer_size );
-	GLsizei idx = 0;
-	for( int i = 0; i < in->num_static_elements; ++i ) {
-		const gui_element_static_text_t* e = &(in->static_elements[i]);
-		// OpenGL has 0/0 in the lower left corner
-		glyph_screen_coords( buf, &idx, e->text, w->font,
-				(float)w->upper_left_x + e->pos_x, (float)w->upper_left_y - e->pos_y );
-	}
-	// Update content of static buffer. Dynamic buffer is updated in gui_window_update()
-	glNamedBufferData( in->static_vertex_buffer, (GLsizeiptr)buffer_size, buf, GL_STATIC_DRAW );
-	free( buf );
-	// Generously grant a maximum of MAX_GUI_ELEMENT_LENGTH per dynamic element
-	const GLsizeiptr s = in->num_dynamic_elements * MAX_GUI_ELEMENT_LENGTH * 6 * (int)sizeof( vec4f );
-	glNamedBufferStorage( in->dynamic_vertex_buffer, s, NULL, GL_MAP_WRITE_BIT );
-	return true;
+	// One range per element, one glyph per byte of its text
+	gui_static_elements_t* e = &(in->static_elements);
+	GLsizei total = 0;
+	for( GLsizei i = 0; i < e->count; ++i ) {
+		if( e->removed[i] )
+			continue;
+		e->glyph_first[i] = total;
+		e->glyph_capacity[i] = (GLsizei)strlen( &(e->text_pool[e->text_offsets[i]]) );
+		total += e->glyph_capacity[i];
+	}
+	// calculate screen rects and texel rects for all window elements into a temporary buffer.
+	// Multibyte utf-8 chars and glyphs without bitmap leave empty instances in their range
+	gui_glyph_t* buf = calloc( (size_t)total, sizeof( gui_glyph_t ) );
+	if( NULL == buf && total > 0 ) {
+		fputs( "Out of memory for gui static glyphs\n", stderr );
+		return false;
+	}
+	for( GLsizei i = 0; i < e->count; ++i ) {
+		if( e->removed[i] )
+			continue;
+		GLsizei idx = e->glyph_first[i];
+		// OpenGL has 0/0 in the lower left corner. The glyphs were pinned with the text
+		const float x = e->pos_x[i];
+		const float y = -e->pos_y[i];
+		if( gui_window_line_visible( w, x, y ) )
+			glyph_screen_coords( buf, &idx, &(e->text_pool[e->text_offsets[i]]), w->font, x, y,
+					gui_window_text_scale( w ), false, gui_window_glyph_clip( w ) );
+		gui_window_tag_glyphs( w, &buf[e->glyph_first[i]], idx - e->glyph_first[i] );
+		e->glyph_count[i] = idx - e->glyph_first[i];
+	}
+	in->num_static_glyphs = in->static_glyph_capacity = total;
+	// Update content of static buffer, later changes patch ranges of it.
+	// Dynamic buffer is updated in gui_window_update()
+	if( 0 != in->static_glyph_buffer ) {
+		glNamedBufferData( in->static_glyph_buffer, (GLsizeiptr)total * (GLsizeiptr)sizeof( gui_glyph_t ), buf,
+				GL_DYNAMIC_DRAW );
+		gui_stats_count_upload( (size_t)total * sizeof( gui_glyph_t ) );
+	}
+	// Kept as the CPU copy of the buffer
+	in->static_glyphs = buf;
+	in->ended = true;
+	// Slots start empty
+	const gui_dynamic_elements_t* d = &(in->dynamic_elements);
+	const GLsizeiptr s = (GLsizeiptr)d->num_slot_glyphs * (GLsizeiptr)sizeof( gui_glyph_t );
+	in->dynamic_glyph_slots = calloc( (size_t)d->num_slot_glyphs, sizeof( gui_glyph_t ) );
+	bool allocated = NULL != in->dynamic_glyph_slots || 0 == s;
+	for( int r = 0; r < GUI_FRAMES_IN_FLIGHT; ++r ) {
+		in->region_generations[r] = calloc( (size_t)d->count, sizeof( unsigned int ) );
+		in->region_num_glyphs[r] = calloc( (size_t)d->count, sizeof( GLsizei ) );
+		allocated = allocated && ( 0 == d->count || ( NULL != in->region_generations[r] && NULL != in->region_num_glyphs[r] ) );
+	}
+	if( !allocated ) {
+		fputs( "Out of memory for gui dynamic glyphs\n", stderr );
+		return false;
+	}
+	return 0 == in->static_glyph_buffer || gui_batch_add_window( w );
+}
+
+bool gui_window_set_clip( gui_window_t* w, float x, float y, float width, float height ) {
+	if( width < 0.0f || height < 0.0f ) {
+		fputs( "Gui window clip rect with negative size\n", stderr );
+		return false;
+	}
+	gui_window_internals_t* in = w->internals;
+	in->clip_x = x;
+	in->clip_y = y;
+	in->clip_width = width;
+	in->clip_height = height;
+	in->clipped = width > 0.0f && height > 0.0f;
+	in->clip = (gui_clip_rect_t){ x, -y - height, x + width, -y };
+	if( !in->ended )
+		return true;
+	// Lay out everything again, glyphs culled before may now be visible
+	in->relayout_dynamic = true;
+	const gui_static_elements_t* e = &(in->static_elements);
+	bool ok = true;
+	for( GLsizei i = 0; i < e->count; ++i )
+		if( !e->removed[i] )
+			ok = gui_window_layout_static_text( w, i ) && ok;
+	return ok;
+}
+
+void gui_window_scissor( const gui_window_t* w ) {
+	const gui_window_internals_t* in = w->internals;
+	if( !in->clipped ) {
+		gl_state_scissor( false, 0, 0, 0, 0 );
+		return;
+	}
+	// Whole pixels around the clip rect on screen
+	const GLint left = w->upper_left_x + (GLint)floorf( in->clip.left );
+	const GLint bottom = w->upper_left_y + (GLint)floorf( in->clip.bottom );
+	const GLint right = w->upper_left_x + (GLint)ceilf( in->clip.right );
+	const GLint top = w->upper_left_y + (GLint)ceilf( in->clip.top );
+	gl_state_scissor( true, left, bottom, right > left ? right - left : 0, top > bottom ? top - bottom : 0 );
 }
 
 // set scissors and draw call;
 void gui_window_render( gui_window_t* w, const vec3f* color ) {
+	const double start = gui_stats_render_begin();
 	gui_window_internals_t* i = w->internals;
-	// @todo glViewport(); glScissor()
-	glEnable( GL_BLEND );
-	glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
-	glUseProgram( shader_program );
-	glBindTextureUnit( 0, w->font->texture_atlas );
-	glUniform3f( glGetUniformLocation( shader_program, "pen_color" ), color->x, color->y, color->z );
+	gui_window_scissor( w );
+	gui_frame_bind();
+	gl_state_blend( true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+	gui_window_set_color( w, color );
+	gl_state_use_program( gui_window_program( w ) );
+	gl_state_bind_texture_unit( 0, font_atlas_texture() );
 	// draw static and dynamic buffer
-	glBindVertexArray( i->vertex_array );
-	glVertexArrayVertexBuffer( i->vertex_array, 0, i->static_vertex_buffer, 0, sizeof( vec4f ) );
-	glDrawArrays( GL_TRIANGLES, 0, i->num_static_vertices );
-	glVertexArrayVertexBuffer( i->vertex_array, 0, i->dynamic_vertex_buffer, 0, sizeof( vec4f ) );
-	glDrawArrays( GL_TRIANGLES, 0, i->num_dynamic_vertices );
+	gl_state_bind_vertex_array( i->vertex_array );
+	glVertexArrayVertexBuffer( i->vertex_array, 0, i->static_glyph_buffer, 0, sizeof( gui_glyph_t ) );
+	glDrawArraysInstanced( GL_TRIANGLE_STRIP, 0, 4, i->num_static_glyphs );
+	gui_stats_count_draw( i->num_static_glyphs );
+	if( i->dynamic_elements.num_slot_glyphs > 0 && gui_window_upload( i ) ) {
+		// All slots at once, their empty glyphs have no area
+		glVertexArrayVertexBuffer( i->vertex_array, 0, i->dynamic_glyphs.buffer,
+				vertex_ring_offset( &i->dynamic_glyphs ), sizeof( gui_glyph_t ) );
+		glDrawArraysInstanced( GL_TRIANGLE_STRIP, 0, 4, i->dynamic_elements.num_slot_glyphs );
+		gui_stats_count_draw( i->dynamic_elements.num_slot_glyphs );
+		vertex_ring_fence( &i->dynamic_glyphs );
+	}
+	// The host's draws are not clipped
+	gl_state_scissor( false, 0, 0, 0, 0 );
+	gui_stats_render_end( start );
+}
+
+void gui_window_ring_stats( const gui_window_t* w, vertex_ring_stats_t* out_stats ) {
+	*out_stats = w->internals->dynamic_glyphs.stats;
 }
 
 void gui_window_delete( gui_window_t* w ) {
-	const gui_window_internals_t* i = w->internals;
-	if( glIsBuffer( i->dynamic_vertex_buffer ) )
-		glDeleteBuffers( 1, &(i->dynamic_vertex_buffer) );
-	if( glIsBuffer( i->static_vertex_buffer ) )
-		glDeleteBuffers( 1, &(i->static_vertex_buffer) );
-	if( glIsVertexArray( i->vertex_array ) )
+	gui_window_internals_t* i = w->internals;
+	gui_batch_remove_window( w );
+	// Created by the first gui_window_render()
+	if( 0 != i->dynamic_glyphs.buffer )
+		vertex_ring_delete( &i->dynamic_glyphs );
+	free( i->dynamic_glyph_slots );
+	for( int r = 0; r < GUI_FRAMES_IN_FLIGHT; ++r ) {
+		free( i->region_generations[r] );
+		free( i->region_num_glyphs[r] );
+	}
+	gui_static_elements_t* s = &(i->static_elements);
+	for( GLsizei e = 0; e < s->count; ++e )
+		if( !s->removed[e] )
+			gui_window_pin_text( w, &(s->text_pool[s->text_offsets[e]]), false );
+	free( s->pos_x );
+	free( s->pos_y );
+	free( s->text_offsets );
+	free( s->text_capacities );
+	free( s->glyph_first );
+	free( s->glyph_count );
+	free( s->glyph_capacity );
+	free( s->removed );
+	free( s->text_pool );
+	free( i->free_static_ranges );
+	free( i->static_glyphs );
+	gui_dynamic_elements_t* d = &(i->dynamic_elements);
+	for( GLsizei e = 0; e < d->count; ++e )
+		gui_window_pin_literals( w, &d->formats[e], false );
+	free( d->pos_x );
+	free( d->pos_y );
+	free( d->datatypes );
+	free( d->variables );
+	free( d->formats );
+	free( d->shown );
+	free( d->generations );
+	free( d->num_glyphs );
+	free( d->slot_first );
+	free( d->slot_size );
+	if( 0 != i->static_glyph_buffer && glIsBuffer( i->static_glyph_buffer ) )
+		glDeleteBuffers( 1, &(i->static_glyph_buffer) );
+	if( 0 != i->vertex_array && glIsVertexArray( i->vertex_array ) ) {
+		gl_state_forget_vertex_array( i->vertex_array );
 		glDeleteVertexArrays( 1, &(i->vertex_array) );
-	// @todo: last window deletes shader porgram !
-	if( glIsProgram( shader_program ) )
-		shader_program_delete( shader_program );
+	}
+	slots_used[i->slot] = false;
+	// Last window deletes the shader programs and the frame block
+	if( 0 == --num_windows && 0 != frame_buffer ) {
+		if( glIsProgram( shader_program ) )
+			shader_program_delete( shader_program );
+		if( glIsProgram( sdf_shader_program ) )
+			shader_program_delete( sdf_shader_program );
+		gl_state_forget_buffer( frame_buffer );
+		glDeleteBuffers( 1, &frame_buffer );
+		frame_buffer = 0;
+		frame_width = frame_height = 0.0f;
+	}
 	if( NULL != w->internals )
 		free( w->internals );
 	if( NULL != w )
 		free( w );
 }
 
-/* Iterates over the chars in text and fills buffer with vec4f.
- * The buffer contents are changed, and the current index into the buffer is returned.
- * The screen positions of the first character in pixels, lower left of the char must
- * be given in the position parameters */
-static bool glyph_screen_coords(
-		vec4f* buffer, GLsizei* index, const char* restrict text, const font_info_t* restrict font,
-		float position_x, float position_y ) {
-	for( const char* p = text; *p; ++p ) {
+void gui_glyph_vertex_array_create( GLuint* vertex_array ) {
+	// One instance per glyph, the quad's corners come from gl_VertexID
+	glCreateVertexArrays( 1, vertex_array );
+	// vec4f attrib: screen rect, uvec4 attrib: texel rect in font atlas, uint attrib: atlas layer
+	glVertexArrayAttribFormat( *vertex_array, 0, 4, GL_FLOAT, GL_FALSE, offsetof( gui_glyph_t, rect ) );
+	glVertexArrayAttribIFormat( *vertex_array, 1, 4, GL_UNSIGNED_SHORT, offsetof( gui_glyph_t, texel_rect ) );
+	glVertexArrayAttribIFormat( *vertex_array, 2, 1, GL_UNSIGNED_INT, offsetof( gui_glyph_t, layer ) );
+	for( GLuint a = 0; a < 3; ++a ) {
+		glVertexArrayAttribBinding( *vertex_array, a, 0 );
+		glEnableVertexArrayAttrib( *vertex_array, a );
+	}
+	glVertexArrayBindingDivisor( *vertex_array, 0, 1 );
+}
+
+// Translates a precomputed quad to the pen and stores it as instance
+static inline void gui_glyph_emit( gui_glyph_t* restrict v, const glyph_quad_t* restrict q,
+		float x, float y, float scale ) {
+#ifdef __SSE__
+	const __m128 rect = _mm_add_ps( _mm_setr_ps( x, y, 0.0f, 0.0f ),
+			_mm_mul_ps( _mm_load_ps( q->rect ), _mm_set1_ps( scale ) ) );
+	_mm_storeu_ps( &v->rect.x, rect );
+#else
+	vec4f_set( &v->rect, x + q->rect[0] * scale, y + q->rect[1] * scale, q->rect[2] * scale, q->rect[3] * scale );
+#endif
+	memcpy( v->texel_rect, q->texel_rect, sizeof( v->texel_rect ) );
+	v->layer = q->layer;
+}
+
+/* ASCII pairs are kerned with the font's table. Fonts with subpixel variants place ASCII glyphs
+ * at whole pixels and take the variant nearest to the fractional pen position.
+ * ASCII glyphs are emitted from the font's precomputed quads, others from their glyph info.
+ * Chars without a glyph are skipped */
+bool glyph_screen_coords(
+		gui_glyph_t* buffer, GLsizei* index, const char* restrict text, const font_info_t* restrict font,
+		float position_x, float position_y, float scale, bool pin, const gui_clip_rect_t* clip ) {
+	const GLuint layer = (GLuint)font->atlas_layer;
+	const char* p = text;
+	// Index of the previous char into the kerning table, >= 96 if there is none
+	unsigned int prev = 96;
+	for( unsigned int c = font_utf8_next( &p ); 0 != c; c = font_utf8_next( &p ) ) {
+		const unsigned int k = c - 32;
+		if( prev < 96 && k < 96 )
+			position_x += font->kerning[prev][k] * scale;
+		prev = k;
+		// The rest of the text is right of the clip rect
+		if( NULL != clip && position_x >= clip->right )
+			break;
+		float pen_x = position_x;
+		unsigned int phase = 0;
+		if( font->subpixel_phases > 1 && k < 96 ) {
+			pen_x = floorf( position_x );
+			phase = (unsigned int)( ( position_x - pen_x ) * (float)font->subpixel_phases + 0.5f );
+			if( phase == font->subpixel_phases ) {
+				pen_x += 1.0f;
+				phase = 0;
+			}
+		}
+		if( k < 96 && NULL != font->quads ) {
+			const glyph_quad_t* q = &font->quads[phase * 96 + k];
+			position_x += q->ax * scale;
+			// Skip glyphs that have no bitmap or are culled
+			if( q->rect[2] > 0.0f && ( NULL == clip || gui_clip_overlaps( clip, pen_x + q->rect[0] * scale,
+					position_y + q->rect[1] * scale, q->rect[2] * scale, q->rect[3] * scale ) ) )
+				gui_glyph_emit( &buffer[(*index)++], q, pen_x, position_y, scale );
+			continue;
+		}
 		// Screen position of this glyph
-		const glyph_info_t* g = &(font->glyphs[((int)(*p))-32]);	// index cast to int to avoid warning
-		const float x2 = position_x + g->bearing_x;
-		const float y2 = position_y - ( g->size_y - g->bearing_y );
+		const glyph_info_t* g = font_get_glyph( font, c, pin );
+		if( NULL == g )
+			continue;
+		if( phase > 0 )
+			g = &font->subpixel_glyphs[( phase - 1 ) * 96 + k];
+		const float x2 = pen_x + g->bearing_x * scale;
+		const float y2 = position_y - ( g->size_y - g->bearing_y ) * scale;
+		const float w = g->size_x * scale;
+		const float h = g->size_y * scale;
 		// Skip glyphs that have no bitmap, but advance the cursor
-		position_x += g->ax;
-		position_y -= g->ay;
-		if( 0 == g->size_x || 0 == g->size_y )
+		position_x += g->ax * scale;
+		position_y -= g->ay * scale;
+		if( 0 == g->size_x || 0 == g->size_y || ( NULL != clip && !gui_clip_overlaps( clip, x2, y2, w, h ) ) )
 			continue;
-		const float x_min = g->offset_x;
-		const float y_min = g->offset_y;
-		const float x_max = g->offset_x + g->size_x / (float)font->texture_width;
-		const float y_max = g->offset_y + g->size_y / (float)font->texture_height;
-		vec4f_set( &buffer[(*index)++], x2,				y2 + g->size_y,	x_min, y_min );
-		vec4f_set( &buffer[(*index)++], x2,				y2,				x_min, y_max );
-		vec4f_set( &buffer[(*index)++], x2 + g->size_x,	y2,				x_max, y_max );
-		vec4f_set( &buffer[(*index)++], x2,				y2 + g->size_y,	x_min, y_min );
-		vec4f_set( &buffer[(*index)++], x2 + g->size_x,	y2,				x_max, y_max );
-		vec4f_set( &buffer[(*index)++], x2 + g->size_x,	y2 + g->size_y,	x_max, y_min );
+		// Offsets are normalized to the layer size, a power of two, so texels are exact
+		gui_glyph_t* v = &buffer[*index];
+		vec4f_set( &v->rect, x2, y2, w, h );
+		v->texel_rect[0] = (GLushort)( g->offset_x * (float)font->texture_width + 0.5f );
+		v->texel_rect[1] = (GLushort)( g->offset_y * (float)font->texture_height + 0.5f );
+		v->texel_rect[2] = (GLushort)g->size_x;
+		v->texel_rect[3] = (GLushort)g->size_y;
+		v->layer = layer;
+		++*index;
 	}
 	return true;
 }
@@ -2,12 +2,31 @@
 #pragma once
 
 #include "font.h"
+#include "vertex_ring.h"
+#include "gui_format.h"
 #include "omath/vec3f.h"
+#include "omath/vec4f.h"
 
-// Length of an elemtn in chars
+// Length of a window title in chars
 #define MAX_GUI_ELEMENT_LENGTH 64
-// Maximum number of static or dynamic elements (total 2*)
-#define MAX_GUI_ELEMENTS_PER_WINDOW 8
+// Frames the GPU may lag behind before updating dynamic vertices waits
+#define GUI_FRAMES_IN_FLIGHT 3
+// Windows alive at once, each has its origin in the uniform block shared by all gui programs
+#define GUI_MAX_WINDOWS 1024
+// Uniform buffer binding point of that block
+#define GUI_FRAME_BINDING 0
+
+// Instance of a glyph quad, the vertex shader expands it to the four corners.
+// All fonts share one texture array, so the layer travels with the glyph and windows
+// with different fonts need no texture switch
+typedef struct {
+	// .xy = lower left relative to the window's upper left, .zw = size in screen pixels
+	vec4f rect;
+	// Left, top, width and height of the glyph's bitmap in its atlas layer, in texels
+	GLushort texel_rect[4];
+	// Atlas layer in the low 16 bits, the window's slot in the high ones
+	GLuint layer;
+} gui_glyph_t;
 
 // Datatypes correspond to float and int.
 typedef enum {
@@ -22,33 +41,129 @@ typedef enum {
 	bool check;
 } gui_element_checkbox_t;*/
 
+// Value of a variable element as last displayed
+typedef union {
+	float f;
+	int i;
+	bool b;
+} gui_variable_value_t;
+
+// Static text elements as structure of arrays, grown as elements are added.
+// The texts are stored 0-terminated one after another in text_pool. Each has room for
+// text_capacities bytes, 0 once removed. A pool that has to grow is rebuilt with the live texts
 typedef struct {
-	float pos_x;
-	float pos_y;
-	char text[MAX_GUI_ELEMENT_LENGTH];
-} gui_element_static_text_t;
+	GLsizei count;
+	GLsizei capacity;
+	float* pos_x;
+	float* pos_y;
+	size_t* text_offsets;
+	size_t* text_capacities;
+	// Range of glyphs in the static buffer. Its capacity is the text's length in bytes,
+	// a replacing text that fits is laid out in place
+	GLsizei* glyph_first;
+	GLsizei* glyph_count;
+	GLsizei* glyph_capacity;
+	// Removed elements keep their number, their range is free. The next added element takes it
+	bool* removed;
+	// Number of the element added last
+	GLsizei last_added;
+	char* text_pool;
+	size_t text_pool_size;
+	size_t text_pool_capacity;
+	// Bytes of the pool taken by live texts and their room
+	size_t text_pool_used;
+} gui_static_elements_t;
 
+// Screen rectangle in pixels, 0/0 is the lower left corner
 typedef struct {
-	float pos_x;
-	float pos_y;
-	// Do use the right datatypes for variable because the pointer will be cast
-	gui_variable_datatype_t datatype;
-	void* variable;
-} gui_element_variable_t;
+	float left;
+	float bottom;
+	float right;
+	float top;
+} gui_clip_rect_t;
+
+// Instances first to first + count - 1 in a glyph buffer
+typedef struct {
+	GLsizei first;
+	GLsizei count;
+} gui_glyph_range_t;
+
+// Variable elements as structure of arrays, grown as elements are added. Checking for changes
+// reads datatypes, variables and shown values only. Every element owns a slot of glyphs
+// sized for the longest output of its format
+typedef struct {
+	GLsizei count;
+	GLsizei capacity;
+	float* pos_x;
+	float* pos_y;
+	// Do use the right datatypes for variables because the pointers will be cast
+	gui_variable_datatype_t* datatypes;
+	void** variables;
+	// Plans compiled from the formats
+	gui_format_t* formats;
+	// The displayed values, glyphs are only laid out again when they change
+	gui_variable_value_t* shown;
+	// Counts layouts, 0 before the first update
+	unsigned int* generations;
+	// Glyphs laid out, first glyph and size of each slot
+	GLsizei* num_glyphs;
+	GLsizei* slot_first;
+	GLsizei* slot_size;
+	// Sum of the slot sizes
+	GLsizei num_slot_glyphs;
+} gui_dynamic_elements_t;
 
 typedef struct {
 	// Set internally - vertex arrays and buffers for the window
 	GLuint vertex_array;
 	// Buffer for static elements
-	GLsizei num_static_elements;
-	gui_element_static_text_t static_elements[MAX_GUI_ELEMENTS_PER_WINDOW];
-	GLsizei num_static_vertices;
-	GLuint static_vertex_buffer;
+	gui_static_elements_t static_elements;
+	// Instances drawn from the static buffer, up to the end of the last range. Glyphs outside
+	// of the elements' counts are empty
+	GLsizei num_static_glyphs;
+	GLsizei static_glyph_capacity;
+	GLuint static_glyph_buffer;
+	// CPU copy of the static buffer's instances, for gui_soft.h
+	gui_glyph_t* static_glyphs;
+	// Ranges of removed or moved elements, reused by later ones
+	gui_glyph_range_t* free_static_ranges;
+	GLsizei num_free_static_ranges;
+	GLsizei free_static_ranges_capacity;
+	// Instances changed since gui_render_all() copied the static buffer, none if first >= end
+	GLsizei static_dirty_first;
+	GLsizei static_dirty_end;
+	// Static elements are laid out when added once the window has ended
+	bool ended;
+	// Clip rect relative to the window's upper left as given to gui_window_set_clip()
+	float clip_x;
+	float clip_y;
+	float clip_width;
+	float clip_height;
+	// Set if the window has a clip rect and is drawn with the scissor test
+	bool clipped;
+	// Relative to the window's upper left, glyphs outside are culled if clipped
+	gui_clip_rect_t clip;
+	// Index of the window's origin and color in the shared uniform block
+	GLuint slot;
+	// Text color as RGBA8, red in the low byte
+	GLuint color;
+	// The next update lays out all variables, because the clip rect changed
+	bool relayout_dynamic;
 	// Buffer for dynamic elements (variables)
-	GLsizei num_dynamic_elements;
-	gui_element_variable_t dynamic_elements[MAX_GUI_ELEMENTS_PER_WINDOW];
-	GLsizei num_dynamic_vertices;
-	GLuint dynamic_vertex_buffer;
+	gui_dynamic_elements_t dynamic_elements;
+	GLsizei num_dynamic_glyphs;
+	// One region per frame in flight, written in gui_window_render(). Made by its first call,
+	// buffer 0 before
+	vertex_ring_t dynamic_glyphs;
+	// The slots of all dynamic elements, here and in each ring region. Glyphs past an element's
+	// count are empty, so all slots are drawn at once. Regions get copies of the slots whose
+	// generation they lack and keep the glyph counts they got
+	gui_glyph_t* dynamic_glyph_slots;
+	unsigned int* region_generations[GUI_FRAMES_IN_FLIGHT];
+	GLsizei* region_num_glyphs[GUI_FRAMES_IN_FLIGHT];
+	// Counts updates that changed any element, and the last one copied to the ring
+	unsigned int dynamic_generation;
+	unsigned int uploaded_generation;
 } gui_window_internals_t;
 
 typedef struct {
@@ -57,20 +172,25 @@ typedef struct {
 	char title[MAX_GUI_ELEMENT_LENGTH];
 	int upper_left_x;
 	int upper_left_y;
-	// Size of application window for relative placement
+	// Size of application window at creation, see gui_resize() for changes
 	float app_window_size_x;
 	float app_window_size_y;
 	// bool has_border;		no border for now
 	// bool is_transparent;	is transparent for now
 	// font for drawing
 	const font_info_t* font;
+	// Text height in pixels, defaults to the font's height. Distance field fonts stay sharp
+	// at any height, coverage fonts blur when scaled. Set before gui_window_end()
+	float text_height;
 	// Internals. Do not use by application.
 	gui_window_internals_t* internals;
 } gui_window_t;
 
 /* Begins a new gui window. Expects title, font used for rendering,
  * position upper left in screnn pixels, width and height of the application window in pixels.
- * @todo: projection matrix must be renewed when app. window size changes */
+ * Glyphs are laid out relative to the window, so moving it or resizing the application
+ * window never generates them again. At most GUI_MAX_WINDOWS windows exist at once.
+ * NULL if the shader program for the font could not be created */
 gui_window_t* gui_window_create( const char* title, const font_info_t* font,
 		int upper_left, int upper_right, float app_window_size_x, float app_window_size_y );
 
@@ -78,34 +198,104 @@ gui_window_t* gui_window_create( const char* title, const font_info_t* font,
  * w must have been created before */
 bool gui_window_begin( const gui_window_t* w );
 
-/* A static text element. It's buffer is only allocated once; it will not change.
- * Element is copied into the window struct.
+/* A static text element. Its glyphs are laid out once and only change with the element.
+ * Element is copied into the window struct, texts may have any length.
  * Renders the 0-terminated string with the gui window's font inside of it
  * at the given position. Gui window position in pixels from upper left of window, not screen.
+ * Elements are numbered from 0 in the order they were added, a new element takes the lowest
+ * number of a removed one first, so the element arrays only grow with the live elements.
+ * internals->static_elements.last_added is the new element's number. Adding after
+ * gui_window_end() inserts the element and uploads its glyphs only.
+ * Fails if the glyphs outside of ASCII can not all be pinned in the font's cache.
  * Gui window must have been created and begun */
 bool gui_window_add_static_text( gui_window_t* w, const char* text, const float pos_x, const float pos_y );
 
-/* A dynamic element for a variable. It's buffer is allocated and filled every frame.
- * Converts variabel name pointer to a string and renders it at given position,
- * data_type determines conversion method (snprintf()).
+/* Replaces the text of a static element. After gui_window_end() only the element's range
+ * of the static buffer is uploaded again, in place if the text is not longer than the one
+ * it was laid out for. Meant for texts that change rarely, use variables for numbers.
+ * Fails like adding, the element keeps its text then */
+bool gui_window_replace_static_text( gui_window_t* w, GLsizei element, const char* text );
+
+/* Removes a static element, its range of the static buffer is emptied and reused.
+ * The numbers of the other elements do not change, the next added element gets this one */
+bool gui_window_remove_static_text( gui_window_t* w, GLsizei element );
+
+/* A dynamic element for a variable. Its glyphs are laid out again whenever the variable changes.
+ * Converts variabel name pointer to a string and renders it at given position.
+ * format is a printf format with one conversion matching data_type, see gui_format.h,
+ * NULL for "%7.2f" or "%9d". It is parsed here once and sizes the element's glyph slot.
+ * Fails if the format's glyphs outside of ASCII can not all be pinned in the font's cache.
+ * Windows hold any number of elements.
  * Gui window position in pixels from upper left
- * Gui window must have been created and begun
- * @todo: pass in conversion string */
+ * Gui window must have been created and begun */
 bool gui_window_add_variable( gui_window_t* w, const gui_variable_datatype_t data_type,
-		void* variable_name, const float pos_x, const float pos_y );
+		void* variable_name, const char* format, const float pos_x, const float pos_y );
+
+/* Clips the window's elements to a rectangle in pixels, positioned from the window's upper left
+ * like its elements. Glyphs entirely outside are culled before their instances are generated,
+ * elements whose line lies outside are not even formatted. Glyphs crossing the border are cut
+ * with glScissor. Width or height 0 removes the clip rect, nothing is culled then.
+ * Gui window must have been created and begun */
+bool gui_window_set_clip( gui_window_t* w, float x, float y, float width, float height );
+
+/* Moves the window's upper left corner to a screen position in pixels. Only updates its origin
+ * in the shared uniform block, glyphs and clip rect move along */
+void gui_window_move( gui_window_t* w, int upper_left_x, int upper_left_y );
+
+/* Sets the window's text color, white until set. Kept in the shared uniform block next to its
+ * origin, so gui_render_all() draws every window in its own color. Channels are rounded to
+ * 8 bits, nothing is uploaded if the color did not change */
+void gui_window_set_color( gui_window_t* w, const vec3f* color );
+
+/* Sets the projection of all gui windows for an application window of width and height pixels.
+ * One uniform buffer update shared by all gui programs, nothing if the size did not change,
+ * so it may be called every frame with the framebuffer size. Windows keep their screen
+ * position measured from the lower left, move them to keep them elsewhere */
+void gui_resize( float width, float height );
+
+/* Binds the uniform block of projection, window origins and colors, done by the render functions */
+void gui_frame_bind();
+
+/* Directory the glyph shaders are loaded from, "src" relative to the working directory until set.
+ * Takes effect for programs created by the next gui_window_create() */
+bool gui_set_shader_directory( const char* directory );
 
 /* Ends a begun gui window and calculates buffers and positions of its elements
  * Gui window must have been created and begun */
 bool gui_window_end( gui_window_t* w );
 
-/* update the buffer data of variable elements in a gui window
- * Gui window must have been created and begun */
+/* update the glyphs of variable elements in a gui window.
+ * Only elements whose variable changed are formatted and laid out, the glyphs are
+ * uploaded by the next gui_window_render() or gui_render_all().
+ * Gui window must have been created and ended */
 bool gui_window_update( gui_window_t* w );
 
-/* set scissors and draw call;
-  Gui window must have been ended */
+/* set scissors and draw call; sets the window's color first, see gui_window_set_color().
+  Gui window must have been ended. See gui_render_all() in gui_batch.h for many windows */
 void gui_window_render( gui_window_t* w, const vec3f* color );
 
+/* Shader program matching the window's font */
+GLuint gui_window_program( const gui_window_t* w );
+
+/* Enables the scissor test for the window's clip rect, or disables it for an unclipped window */
+void gui_window_scissor( const gui_window_t* w );
+
+/* Creates a vertex array for gui_glyph_t instances from binding 0 */
+void gui_glyph_vertex_array_create( GLuint* vertex_array );
+
+/* Frame and fence wait counters of the dynamic glyph ring, all 0 before gui_window_render() */
+void gui_window_ring_stats( const gui_window_t* w, vertex_ring_stats_t* out_stats );
+
+/* Iterates over the utf-8 chars in text and writes one glyph instance per char with a bitmap
+ * to buffer, starting at *index, which is advanced past them. The lower left screen position
+ * of the first char in pixels is given in position_x/y, glyph metrics are multiplied with scale.
+ * Glyphs of chars outside of the font's preloaded ones are pinned in its cache if pin is set.
+ * If clip is not NULL, glyphs entirely outside of it are skipped and the text ends where
+ * the pen passes its right edge */
+bool glyph_screen_coords( gui_glyph_t* buffer, GLsizei* index, const char* restrict text,
+		const font_info_t* restrict font, float position_x, float position_y, float scale, bool pin,
+		const gui_clip_rect_t* clip );
+
 /* Deletes a creates gui window and cleans up
  * Gui window must have been created */
 void gui_window_delete( gui_window_t* w );
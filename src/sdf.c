@@ -0,0 +1,98 @@
+
+#include "sdf.h"
+#include <stdlib.h>
+#include <math.h>
+
+#define SDF_FAR 9999
+
+typedef struct {
+	int dx;
+	int dy;
+} sdf_point_t;
+
+static void sdf_transform( sdf_point_t* grid, int width, int height );
+
+static inline int sdf_dist_sq( sdf_point_t p ) {
+	return p.dx * p.dx + p.dy * p.dy;
+}
+
+bool sdf_generate( const unsigned char* bitmap, int width, int height, int pitch, int spread, unsigned char* out ) {
+	const int w = width + 2 * spread;
+	const int h = height + 2 * spread;
+	sdf_point_t* inside = malloc( (size_t)( w * h ) * sizeof( sdf_point_t ) );
+	sdf_point_t* outside = malloc( (size_t)( w * h ) * sizeof( sdf_point_t ) );
+	if( NULL == inside || NULL == outside ) {
+		free( inside );
+		free( outside );
+		return false;
+	}
+	// inside holds the distance to the nearest inside pixel, outside to the nearest outside pixel
+	const sdf_point_t zero = { 0, 0 };
+	const sdf_point_t far = { SDF_FAR, SDF_FAR };
+	for( int y = 0; y < h; ++y )
+		for( int x = 0; x < w; ++x ) {
+			const int bx = x - spread;
+			const int by = y - spread;
+			const bool in = bx >= 0 && by >= 0 && bx < width && by < height && bitmap[by * pitch + bx] >= 128;
+			inside[y * w + x] = in ? zero : far;
+			outside[y * w + x] = in ? far : zero;
+		}
+	sdf_transform( inside, w, h );
+	sdf_transform( outside, w, h );
+	for( int i = 0; i < w * h; ++i ) {
+		const float d = sqrtf( (float)sdf_dist_sq( outside[i] ) ) - sqrtf( (float)sdf_dist_sq( inside[i] ) );
+		float v = 0.5f + d / ( 2.0f * (float)spread );
+		v = v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
+		out[i] = (unsigned char)( v * 255.0f + 0.5f );
+	}
+	free( inside );
+	free( outside );
+	return true;
+}
+
+static inline void sdf_compare( sdf_point_t* grid, int width, int height, sdf_point_t* p,
+		int x, int y, int offset_x, int offset_y ) {
+	const int ox = x + offset_x;
+	const int oy = y + offset_y;
+	if( ox < 0 || oy < 0 || ox >= width || oy >= height )
+		return;
+	sdf_point_t other = grid[oy * width + ox];
+	other.dx += offset_x;
+	other.dy += offset_y;
+	if( sdf_dist_sq( other ) < sdf_dist_sq( *p ) )
+		*p = other;
+}
+
+// Two sweeps, each forward and backward along the rows
+static void sdf_transform( sdf_point_t* grid, int width, int height ) {
+	for( int y = 0; y < height; ++y ) {
+		for( int x = 0; x < width; ++x ) {
+			sdf_point_t p = grid[y * width + x];
+			sdf_compare( grid, width, height, &p, x, y, -1, 0 );
+			sdf_compare( grid, width, height, &p, x, y, 0, -1 );
+			sdf_compare( grid, width, height, &p, x, y, -1, -1 );
+			sdf_compare( grid, width, height, &p, x, y, 1, -1 );
+			grid[y * width + x] = p;
+		}
+		for( int x = width - 1; x >= 0; --x ) {
+			sdf_point_t p = grid[y * width + x];
+			sdf_compare( grid, width, height, &p, x, y, 1, 0 );
+			grid[y * width + x] = p;
+		}
+	}
+	for( int y = height - 1; y >= 0; --y ) {
+		for( int x = width - 1; x >= 0; --x ) {
+			sdf_point_t p = grid[y * width + x];
+			sdf_compare( grid, width, height, &p, x, y, 1, 0 );
+			sdf_compare( grid, width, height, &p, x, y, 0, 1 );
+			sdf_compare( grid, width, height, &p, x, y, -1, 1 );
+			sdf_compare( grid, width, height, &p, x, y, 1, 1 );
+			grid[y * width + x] = p;
+		}
+		for( int x = 0; x < width; ++x ) {
+			sdf_point_t p = grid[y * width + x];
+			sdf_compare( grid, width, height, &p, x, y, -1, 0 );
+			grid[y * width + x] = p;
+		}
+	}
+}
@@ -0,0 +1,15 @@
+/*
+ * Signed distance fields from glyph coverage bitmaps, 8-point sequential Euclidean
+ * distance transform (8SSEDT) for the inside and the outside of the glyph.
+ * http://www.codersnotes.com/notes/signed-distance-fields/
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+/* Converts a coverage bitmap of width * height pixels into a distance field of
+ * (width + 2 * spread) * (height + 2 * spread) pixels. 128 is the outline, values grow
+ * to the inside and reach 0 / 255 at spread pixels distance.
+ * Returns false if memory for the transform could not be allocated */
+bool sdf_generate( const unsigned char* bitmap, int width, int height, int pitch, int spread, unsigned char* out );
@@ -1,5 +1,6 @@
 
 #include "shader_program.h"
+#include "gl_state.h"
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -73,8 +74,10 @@ bool shader_program_create( GLuint* out_program, const char* vertex_shader_file,
 }
 
 void shader_program_delete( GLuint program ) {
-	if( glIsProgram( program ) )
+	if( glIsProgram( program ) ) {
+		gl_state_forget_program( program );
 		glDeleteProgram( program );
+	}
 	printf( "Shader program #%d destroyed\n", program );
 }
 
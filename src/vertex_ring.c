@@ -0,0 +1,89 @@
+#define _POSIX_C_SOURCE 200809L	// clock_gettime() also with -std=c11
+
+#include "vertex_ring.h"
+#include <stdio.h>
+#include <string.h>	// memset()
+#include <time.h>	// clock_gettime()
+
+// Fence waits time out after 1 second, and are retried
+#define VERTEX_RING_WAIT_TIMEOUT_NS 1000000000ull
+
+static double vertex_ring_now_ms() {
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (double)t.tv_sec * 1e3 + (double)t.tv_nsec * 1e-6;
+}
+
+bool vertex_ring_create( vertex_ring_t* r, GLsizeiptr region_size, int num_regions ) {
+	memset( r, 0, sizeof( vertex_ring_t ) );
+	if( num_regions < 1 || num_regions > VERTEX_RING_MAX_REGIONS ) {
+		fprintf( stderr, "Vertex ring needs 1-%d regions\n", VERTEX_RING_MAX_REGIONS );
+		return false;
+	}
+	// An empty ring still gets a valid buffer
+	r->region_size = region_size > 0 ? region_size : 1;
+	r->num_regions = num_regions;
+	r->region = num_regions - 1;
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers( 1, &r->buffer );
+	glNamedBufferStorage( r->buffer, r->region_size * num_regions, NULL, flags );
+	r->mapping = glMapNamedBufferRange( r->buffer, 0, r->region_size * num_regions, flags );
+	if( NULL == r->mapping ) {
+		fputs( "Error mapping vertex ring buffer\n", stderr );
+		glDeleteBuffers( 1, &r->buffer );
+		r->buffer = 0;
+		return false;
+	}
+	return true;
+}
+
+void* vertex_ring_begin( vertex_ring_t* r ) {
+	r->region = ( r->region + 1 ) % r->num_regions;
+	++r->stats.frames;
+	GLsync fence = r->fences[r->region];
+	if( NULL != fence ) {
+		GLenum status = glClientWaitSync( fence, 0, 0 );
+		if( GL_TIMEOUT_EXPIRED == status ) {
+			// The GPU still reads this region
+			const double t0 = vertex_ring_now_ms();
+			do
+				status = glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, VERTEX_RING_WAIT_TIMEOUT_NS );
+			while( GL_TIMEOUT_EXPIRED == status );
+			const double t = vertex_ring_now_ms() - t0;
+			++r->stats.waits;
+			r->stats.last_wait_ms = t;
+			r->stats.total_wait_ms += t;
+			if( t > r->stats.max_wait_ms )
+				r->stats.max_wait_ms = t;
+		}
+		glDeleteSync( fence );
+		r->fences[r->region] = NULL;
+		if( GL_WAIT_FAILED == status ) {
+			fputs( "Error waiting for vertex ring fence\n", stderr );
+			return NULL;
+		}
+	}
+	return r->mapping + vertex_ring_offset( r );
+}
+
+GLintptr vertex_ring_offset( const vertex_ring_t* r ) {
+	return (GLintptr)r->region * r->region_size;
+}
+
+void vertex_ring_fence( vertex_ring_t* r ) {
+	// Drawing from the same region again replaces its fence
+	if( NULL != r->fences[r->region] )
+		glDeleteSync( r->fences[r->region] );
+	r->fences[r->region] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
+
+void vertex_ring_delete( vertex_ring_t* r ) {
+	for( int i = 0; i < r->num_regions; ++i )
+		if( NULL != r->fences[i] )
+			glDeleteSync( r->fences[i] );
+	if( glIsBuffer( r->buffer ) ) {
+		glUnmapNamedBuffer( r->buffer );
+		glDeleteBuffers( 1, &r->buffer );
+	}
+	memset( r, 0, sizeof( vertex_ring_t ) );
+}
@@ -0,0 +1,52 @@
+/*
+ * Ring of buffer regions for vertices written by the CPU every frame.
+ * One immutable buffer is persistently and coherently mapped, each frame writes the next
+ * region while the GPU may still read the ones before. A fence per region guards against
+ * overwriting vertices that are still in use, so writes only wait if the GPU is more than
+ * num_regions - 1 frames behind. The time spent waiting is counted.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "glad/glad.h"
+
+#define VERTEX_RING_MAX_REGIONS 4
+
+typedef struct {
+	// Regions begun
+	unsigned long frames;
+	// Begins that found their region's fence unsignaled and had to wait
+	unsigned long waits;
+	// Wait times in milliseconds
+	double last_wait_ms;
+	double max_wait_ms;
+	double total_wait_ms;
+} vertex_ring_stats_t;
+
+typedef struct {
+	GLuint buffer;
+	unsigned char* mapping;
+	// Bytes per region
+	GLsizeiptr region_size;
+	int num_regions;
+	// Region currently written and drawn from
+	int region;
+	GLsync fences[VERTEX_RING_MAX_REGIONS];
+	vertex_ring_stats_t stats;
+} vertex_ring_t;
+
+/* Creates the buffer with num_regions regions of region_size bytes and maps it */
+bool vertex_ring_create( vertex_ring_t* r, GLsizeiptr region_size, int num_regions );
+
+/* Moves on to the next region, waits until the GPU is done with it and
+ * returns it for writing. NULL if the wait failed */
+void* vertex_ring_begin( vertex_ring_t* r );
+
+/* Byte offset of the current region in the buffer, for binding it as vertex buffer */
+GLintptr vertex_ring_offset( const vertex_ring_t* r );
+
+/* Fences the current region after the draw calls reading from it were issued */
+void vertex_ring_fence( vertex_ring_t* r );
+
+void vertex_ring_delete( vertex_ring_t* r );
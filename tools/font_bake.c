@@ -0,0 +1,33 @@
+/*
+ * Offline bake step: rasterizes a font with FreeType and writes atlas and metrics
+ * to a baked font file that font_create_from_baked() loads without FreeType.
+ * Needs no display or GL context, the atlas is built from the font's CPU image.
+ * Usage: font_bake <font file> <height in pixels> <baked font file>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "src/font.h"
+#include "src/gl_state.h"
+
+int main( int argc, char** argv ) {
+	if( 4 != argc ) {
+		fputs( "Usage: font_bake <font file> <height in pixels> <baked font file>\n", stderr );
+		return EXIT_FAILURE;
+	}
+	const int height = atoi( argv[2] );
+	if( height <= 0 ) {
+		fprintf( stderr, "Invalid font height '%s'\n", argv[2] );
+		return EXIT_FAILURE;
+	}
+	// Fonts made without GL keep everything font_bake() reads on the CPU
+	gl_state_set_available( false );
+	font_info_t* font = font_create( argv[1], (unsigned int)height );
+	if( NULL == font )
+		return EXIT_FAILURE;
+	const bool ok = font_bake( font, argv[3] );
+	if( ok )
+		printf( "Baked '%s' at %d pixels to '%s'\n", argv[1], height, argv[3] );
+	font_delete( font );
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,441 @@
+/*
+ * Headless harness: renders scripted gui scenes through the gui_window API into an offscreen
+ * framebuffer of a surfaceless or pbuffer EGL context, so it runs on Mesa's llvmpipe without a
+ * GPU or display. Reports CPU and GL time per frame and compares the last frame of each scene
+ * with a reference image, or records the references.
+ * Usage: gui_headless <font file> [frames] [record|compare <directory>] [tolerance]
+ * The shaders are loaded from src/ next to the executable or one directory up, else from src/ in
+ * the working directory. References are named after the scene and the number of frames, so they
+ * are only compared with runs of as many frames.
+ * Exits with failure if a scene can not be drawn, its last frame is empty or differs from its
+ * reference by more than tolerance in any channel.
+ */
+
+#define _POSIX_C_SOURCE 200809L	// clock_gettime() also with -std=c11
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>	// readlink()
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "glad/glad.h"
+#include "src/gui_window.h"
+#include "src/gui_batch.h"
+#include "src/gui_soft.h"
+
+#define HEADLESS_WIDTH 640
+#define HEADLESS_HEIGHT 360
+#define HEADLESS_FRAMES 100
+// Channel difference to a reference tolerated, drivers differ in filtering and rounding
+#define HEADLESS_TOLERANCE 2
+#define HEADLESS_MAX_WINDOWS 4
+#define HEADLESS_MAX_PATH 512
+
+// State of a scene, variables need fixed addresses
+typedef struct {
+	font_info_t* font;
+	gui_window_t* windows[HEADLESS_MAX_WINDOWS];
+	int num_windows;
+	// Drawn with gui_render_all() instead of gui_window_render() for each window
+	bool batched;
+	float value;
+	int counter;
+	unsigned int hex;
+	char text[MAX_GUI_ELEMENT_LENGTH];
+	// Static element removed on the next odd frame
+	GLsizei last_static;
+} headless_scene_t;
+
+typedef struct {
+	const char* name;
+	bool ( *create )( headless_scene_t* s, const char* font_file );
+	// Sets up frame i before the windows are updated and drawn
+	void ( *frame )( headless_scene_t* s, int i );
+} headless_script_t;
+
+static double headless_now() {
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+// NULL if the window can not be created or drawn
+static gui_window_t* headless_window( headless_scene_t* s, const char* title, int x, int y ) {
+	gui_window_t* w = gui_window_create( title, s->font, x, y, (float)HEADLESS_WIDTH, (float)HEADLESS_HEIGHT );
+	if( NULL == w || !gui_window_begin( w ) )
+		return NULL;
+	s->windows[s->num_windows++] = w;
+	// Without a program the window draws nothing
+	return 0 != gui_window_program( w ) ? w : NULL;
+}
+
+/* Labels and variables of every type in three batched windows */
+static bool headless_labels_create( headless_scene_t* s, const char* font_file ) {
+	s->font = font_create( font_file, 14 );
+	s->batched = true;
+	if( NULL == s->font )
+		return false;
+	for( int k = 0; k < 3; ++k ) {
+		gui_window_t* w = headless_window( s, "labels", 10 + 210 * k, HEADLESS_HEIGHT - 10 );
+		if( NULL == w )
+			return false;
+		gui_window_add_static_text( w, "Frame time:", 1.0f, 15.0f );
+		gui_window_add_static_text( w, "Frame #:", 1.0f, 30.0f );
+		gui_window_add_static_text( w, "Checksum:", 1.0f, 45.0f );
+		gui_window_add_static_text( w, "AVWay Tg kerning, 0123456789", 1.0f, 60.0f );
+		gui_window_add_variable( w, gui_float, &s->value, "%8.3f", 90.0f, 15.0f );
+		gui_window_add_variable( w, gui_int, &s->counter, "%6d", 90.0f, 30.0f );
+		gui_window_add_variable( w, gui_int, &s->hex, "%08X", 90.0f, 45.0f );
+		if( !gui_window_end( w ) )
+			return false;
+	}
+	return true;
+}
+
+static void headless_labels_frame( headless_scene_t* s, int i ) {
+	s->value = 16.0f + (float)( i % 7 ) * 0.125f;
+	s->counter = i;
+	s->hex = (unsigned int)i * 2654435761u;
+}
+
+/* Static texts replaced, removed and inserted after the window ended */
+static bool headless_mutate_create( headless_scene_t* s, const char* font_file ) {
+	s->font = font_create( font_file, 14 );
+	if( NULL == s->font )
+		return false;
+	gui_window_t* w = headless_window( s, "mutate", 10, HEADLESS_HEIGHT - 10 );
+	if( NULL == w )
+		return false;
+	gui_window_add_static_text( w, "Status: starting", 1.0f, 15.0f );
+	gui_window_add_static_text( w, "Removed on odd frames", 1.0f, 30.0f );
+	gui_window_add_variable( w, gui_int, &s->counter, NULL, 1.0f, 45.0f );
+	s->last_static = 1;
+	return gui_window_end( w );
+}
+
+static void headless_mutate_frame( headless_scene_t* s, int i ) {
+	gui_window_t* w = s->windows[0];
+	s->counter = i;
+	// Texts of changing length move between ranges of the static buffer
+	snprintf( s->text, sizeof( s->text ), "Status: %.*s", 1 + i % 24, "running, all systems nominal" );
+	gui_window_replace_static_text( w, 0, s->text );
+	// An added element takes the number of the removed one
+	if( 1 == i % 2 )
+		gui_window_remove_static_text( w, s->last_static );
+	else if( i > 0 && gui_window_add_static_text( w, "Added again on even frames", 1.0f, 30.0f + (float)( i % 10 ) ) )
+		s->last_static = w->internals->static_elements.last_added;
+}
+
+/* Clipped windows, one moving and one with a changing clip rect */
+static bool headless_clip_create( headless_scene_t* s, const char* font_file ) {
+	s->font = font_create( font_file, 14 );
+	s->batched = true;
+	if( NULL == s->font )
+		return false;
+	for( int k = 0; k < 2; ++k ) {
+		gui_window_t* w = headless_window( s, "clip", 20 + 300 * k, HEADLESS_HEIGHT - 40 );
+		if( NULL == w )
+			return false;
+		for( int line = 0; line < 12; ++line )
+			gui_window_add_static_text( w, "Clipped text runs past the border of its window", 1.0f,
+					15.0f * (float)( line + 1 ) );
+		gui_window_add_variable( w, gui_float, &s->value, NULL, 150.0f, 15.0f );
+		gui_window_set_clip( w, 0.0f, 0.0f, 180.0f, 120.0f );
+		if( !gui_window_end( w ) )
+			return false;
+	}
+	return true;
+}
+
+static void headless_clip_frame( headless_scene_t* s, int i ) {
+	s->value = (float)i * 1.5f;
+	gui_window_move( s->windows[0], 20 + i % 40, HEADLESS_HEIGHT - 40 - i % 20 );
+	gui_window_set_clip( s->windows[1], (float)( i % 16 ), 5.0f, 120.0f + (float)( i % 50 ), 100.0f );
+}
+
+/* A distance field font drawn at two heights */
+static bool headless_sdf_create( headless_scene_t* s, const char* font_file ) {
+	s->font = font_create_sdf( font_file, 32 );
+	if( NULL == s->font )
+		return false;
+	const float heights[2] = { 12.0f, 40.0f };
+	for( int k = 0; k < 2; ++k ) {
+		gui_window_t* w = headless_window( s, "sdf", 10, HEADLESS_HEIGHT - 10 - 60 * k );
+		if( NULL == w )
+			return false;
+		w->text_height = heights[k];
+		gui_window_add_static_text( w, "Distance field text", 1.0f, heights[k] );
+		gui_window_add_variable( w, gui_float, &s->value, NULL, 14.0f * heights[k], heights[k] );
+		if( !gui_window_end( w ) )
+			return false;
+	}
+	return true;
+}
+
+static void headless_sdf_frame( headless_scene_t* s, int i ) {
+	s->value = 100.0f / (float)( 1 + i );
+}
+
+static const headless_script_t headless_scripts[] = {
+	{ "labels", headless_labels_create, headless_labels_frame },
+	{ "mutate", headless_mutate_create, headless_mutate_frame },
+	{ "clip", headless_clip_create, headless_clip_frame },
+	{ "sdf", headless_sdf_create, headless_sdf_frame }
+};
+
+static void headless_scene_delete( headless_scene_t* s ) {
+	for( int k = 0; k < s->num_windows; ++k )
+		gui_window_delete( s->windows[k] );
+	if( NULL != s->font )
+		font_delete( s->font );
+	memset( s, 0, sizeof( headless_scene_t ) );
+}
+
+/* A GL 4.5 core context without a window. Prefers Mesa's surfaceless platform, else the default
+ * display with a small pbuffer. Drawing goes to a framebuffer object anyway */
+static bool headless_context( EGLDisplay* out_display, EGLSurface* out_surface, EGLContext* out_context ) {
+	EGLDisplay display = EGL_NO_DISPLAY;
+	const char* extensions = eglQueryString( EGL_NO_DISPLAY, EGL_EXTENSIONS );
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+	if( NULL != extensions && NULL != strstr( extensions, "EGL_MESA_platform_surfaceless" ) && NULL != get_platform_display )
+		display = get_platform_display( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL );
+	if( EGL_NO_DISPLAY == display )
+		display = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+	EGLint major, minor;
+	if( EGL_NO_DISPLAY == display || !eglInitialize( display, &major, &minor ) ) {
+		fputs( "No EGL display\n", stderr );
+		return false;
+	}
+	const EGLint config_attributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE
+	};
+	EGLConfig config;
+	EGLint num_configs = 0;
+	if( !eglChooseConfig( display, config_attributes, &config, 1, &num_configs ) || 0 == num_configs ) {
+		fputs( "No EGL config for desktop OpenGL\n", stderr );
+		eglTerminate( display );
+		return false;
+	}
+	const EGLint context_attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 5,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE
+	};
+	const EGLint pbuffer_attributes[] = { EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE };
+	EGLContext context = EGL_NO_CONTEXT;
+	if( eglBindAPI( EGL_OPENGL_API ) )
+		context = eglCreateContext( display, config, EGL_NO_CONTEXT, context_attributes );
+	// Surfaceless contexts need no surface, else a pbuffer serves
+	EGLSurface surface = EGL_NO_SURFACE;
+	if( EGL_NO_CONTEXT != context && !eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, context ) ) {
+		surface = eglCreatePbufferSurface( display, config, pbuffer_attributes );
+		if( EGL_NO_SURFACE == surface || !eglMakeCurrent( display, surface, surface, context ) ) {
+			if( EGL_NO_SURFACE != surface )
+				eglDestroySurface( display, surface );
+			eglDestroyContext( display, context );
+			context = EGL_NO_CONTEXT;
+		}
+	}
+	if( EGL_NO_CONTEXT == context || !gladLoadGLLoader( (GLADloadproc)eglGetProcAddress ) ) {
+		fputs( "No OpenGL 4.5 core context\n", stderr );
+		eglTerminate( display );
+		return false;
+	}
+	printf( "EGL %d.%d, %s, %s\n", major, minor, glGetString( GL_RENDERER ), glGetString( GL_VERSION ) );
+	*out_display = display;
+	*out_surface = surface;
+	*out_context = context;
+	return true;
+}
+
+static void headless_report( const char* what, const double* t, int n ) {
+	double min = t[0], max = t[0], sum = 0.0;
+	for( int i = 0; i < n; ++i ) {
+		min = t[i] < min ? t[i] : min;
+		max = t[i] > max ? t[i] : max;
+		sum += t[i];
+	}
+	printf( "  %-4s min %8.3f ms   mean %8.3f ms   max %8.3f ms\n", what, min * 1e3, sum * 1e3 / n, max * 1e3 );
+}
+
+/* Points the gui to src/ next to the executable or one directory up, if the shaders are there */
+static void headless_find_shaders() {
+	char path[HEADLESS_MAX_PATH];
+	const ssize_t n = readlink( "/proc/self/exe", path, sizeof( path ) - 1 );
+	if( n <= 0 )
+		return;
+	path[n] = '\0';
+	char* slash = strrchr( path, '/' );
+	if( NULL == slash )
+		return;
+	*slash = '\0';
+	const char* const candidates[2] = { "%s/src", "%s/../src" };
+	for( int c = 0; c < 2; ++c ) {
+		char directory[HEADLESS_MAX_PATH];
+		char file[HEADLESS_MAX_PATH];
+		if( snprintf( directory, sizeof( directory ), candidates[c], path ) >= (int)sizeof( directory ) ||
+				snprintf( file, sizeof( file ), "%s/glyph_shader.vs", directory ) >= (int)sizeof( file ) )
+			continue;
+		FILE* f = fopen( file, "r" );
+		if( NULL != f ) {
+			fclose( f );
+			gui_set_shader_directory( directory );
+			return;
+		}
+	}
+}
+
+/* True if every pixel of the frame has the clear color, nothing was drawn */
+static bool headless_empty( const gui_soft_framebuffer_t* frame ) {
+	for( size_t p = 1; p < (size_t)frame->width * frame->height; ++p )
+		if( 0 != memcmp( &frame->pixels[4 * p], &frame->pixels[0], 4 ) )
+			return false;
+	return true;
+}
+
+/* Compares a frame with a reference, prints the result. False if they differ by more than tolerance */
+static bool headless_compare( const gui_soft_framebuffer_t* frame, const char* filename, int tolerance ) {
+	gui_soft_framebuffer_t reference;
+	if( !gui_soft_read_ppm( &reference, filename ) )
+		return false;
+	if( reference.width != frame->width || reference.height != frame->height ) {
+		printf( "  reference %s is %ux%u, the frame %ux%u\n", filename, reference.width, reference.height,
+				frame->width, frame->height );
+		gui_soft_framebuffer_delete( &reference );
+		return false;
+	}
+	size_t differing = 0;
+	int max_difference = 0;
+	for( size_t p = 0; p < (size_t)frame->width * frame->height; ++p ) {
+		int d = 0;
+		for( int c = 0; c < 3; ++c ) {
+			const int e = abs( frame->pixels[4 * p + c] - reference.pixels[4 * p + c] );
+			d = e > d ? e : d;
+		}
+		max_difference = d > max_difference ? d : max_difference;
+		differing += d > tolerance;
+	}
+	gui_soft_framebuffer_delete( &reference );
+	printf( "  reference %s: %zu pixels differ by more than %d, at most %d, %s\n", filename, differing, tolerance,
+			max_difference, 0 == differing ? "OK" : "FAILED" );
+	return 0 == differing;
+}
+
+/* Renders frames of a scene and checks the last one. False if it could not run or its frame
+ * does not match the reference */
+static bool headless_run( const headless_script_t* script, const char* font_file, int frames, const char* mode,
+		const char* directory, int tolerance ) {
+	printf( "%s: %d frames\n", script->name, frames );
+	headless_scene_t scene;
+	memset( &scene, 0, sizeof( scene ) );
+	double* cpu = malloc( (size_t)frames * sizeof( double ) );
+	double* gpu = malloc( (size_t)frames * sizeof( double ) );
+	GLuint* queries = malloc( (size_t)frames * sizeof( GLuint ) );
+	gui_soft_framebuffer_t frame = { 0 };
+	bool ok = NULL != cpu && NULL != gpu && NULL != queries &&
+			gui_soft_framebuffer_create( &frame, HEADLESS_WIDTH, HEADLESS_HEIGHT ) && script->create( &scene, font_file );
+	if( ok ) {
+		glCreateQueries( GL_TIME_ELAPSED, frames, queries );
+		// Uploads of the scene's creation are not part of the first frame
+		glFinish();
+		const vec3f color = { 1.0f, 1.0f, 0.5f };
+		for( int i = 0; i < frames; ++i ) {
+			glClearColor( 0.3f, 0.3f, 0.3f, 1.0f );
+			glClear( GL_COLOR_BUFFER_BIT );
+			// Only the gui's work is timed
+			const double t0 = headless_now();
+			glBeginQuery( GL_TIME_ELAPSED, queries[i] );
+			script->frame( &scene, i );
+			for( int k = 0; k < scene.num_windows; ++k )
+				gui_window_update( scene.windows[k] );
+			if( scene.batched ) {
+				for( int k = 0; k < scene.num_windows; ++k )
+					gui_window_set_color( scene.windows[k], &color );
+				gui_render_all();
+			} else
+				for( int k = 0; k < scene.num_windows; ++k )
+					gui_window_render( scene.windows[k], &color );
+			glEndQuery( GL_TIME_ELAPSED );
+			cpu[i] = headless_now() - t0;
+		}
+		// All queries are read at the end, so no frame waits for the GPU
+		for( int i = 0; i < frames; ++i ) {
+			GLuint64 ns;
+			glGetQueryObjectui64v( queries[i], GL_QUERY_RESULT, &ns );
+			gpu[i] = (double)ns * 1e-9;
+		}
+		glDeleteQueries( frames, queries );
+		headless_report( "cpu", cpu, frames );
+		headless_report( "gl", gpu, frames );
+		GLint alignment;
+		glGetIntegerv( GL_PACK_ALIGNMENT, &alignment );
+		glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+		glReadPixels( 0, 0, HEADLESS_WIDTH, HEADLESS_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, frame.pixels );
+		glPixelStorei( GL_PACK_ALIGNMENT, alignment );
+		const GLenum error = glGetError();
+		if( GL_NO_ERROR != error ) {
+			printf( "  GL error 0x%x\n", error );
+			ok = false;
+		}
+		// Blank references would let every later blank frame pass
+		if( ok && headless_empty( &frame ) ) {
+			puts( "  the last frame is empty, nothing was drawn" );
+			ok = false;
+		}
+		char filename[HEADLESS_MAX_PATH];
+		snprintf( filename, sizeof( filename ), "%s/%s_%d.ppm", directory, script->name, frames );
+		if( ok && 0 == strcmp( mode, "record" ) ) {
+			ok = gui_soft_write_ppm( &frame, filename );
+			if( ok )
+				printf( "  recorded %s\n", filename );
+		} else if( ok && 0 == strcmp( mode, "compare" ) )
+			ok = headless_compare( &frame, filename, tolerance );
+	} else
+		fprintf( stderr, "Could not set up scene %s\n", script->name );
+	headless_scene_delete( &scene );
+	gui_soft_framebuffer_delete( &frame );
+	free( queries );
+	free( gpu );
+	free( cpu );
+	return ok;
+}
+
+int main( int argc, char** argv ) {
+	const int frames = argc > 2 ? atoi( argv[2] ) : HEADLESS_FRAMES;
+	const char* mode = argc > 3 ? argv[3] : "";
+	if( argc < 2 || frames <= 0 || ( argc > 3 && ( argc < 5 ||
+			( 0 != strcmp( mode, "record" ) && 0 != strcmp( mode, "compare" ) ) ) ) ) {
+		fputs( "Usage: gui_headless <font file> [frames] [record|compare <directory>] [tolerance]\n", stderr );
+		return EXIT_FAILURE;
+	}
+	const char* directory = argc > 4 ? argv[4] : ".";
+	const int tolerance = argc > 5 ? atoi( argv[5] ) : HEADLESS_TOLERANCE;
+	EGLDisplay display;
+	EGLSurface surface;
+	EGLContext context;
+	if( !headless_context( &display, &surface, &context ) )
+		return EXIT_FAILURE;
+	headless_find_shaders();
+	GLuint framebuffer, renderbuffer;
+	glCreateFramebuffers( 1, &framebuffer );
+	glCreateRenderbuffers( 1, &renderbuffer );
+	glNamedRenderbufferStorage( renderbuffer, GL_RGBA8, HEADLESS_WIDTH, HEADLESS_HEIGHT );
+	glNamedFramebufferRenderbuffer( framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer );
+	glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+	glViewport( 0, 0, HEADLESS_WIDTH, HEADLESS_HEIGHT );
+	int failed = 0;
+	for( size_t k = 0; k < sizeof( headless_scripts ) / sizeof( headless_scripts[0] ); ++k )
+		failed += !headless_run( &headless_scripts[k], argv[1], frames, mode, directory, tolerance );
+	glDeleteFramebuffers( 1, &framebuffer );
+	glDeleteRenderbuffers( 1, &renderbuffer );
+	eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+	eglDestroyContext( display, context );
+	if( EGL_NO_SURFACE != surface )
+		eglDestroySurface( display, surface );
+	eglTerminate( display );
+	if( failed > 0 )
+		printf( "%d scenes failed\n", failed );
+	return 0 == failed ? EXIT_SUCCESS : EXIT_FAILURE;
+}